@@ -0,0 +1,49 @@
+#pragma once
+
+/*
+ * Shared harness of the host benchmarks in bench/.
+ *
+ * Built by the native_bench environment (pio run -e native_bench), which links the firmware
+ * against the NativeHal shims; bench_main.cpp's main() replaces the shim's main loop and runs
+ * every suite in turn.
+ */
+#include <Arduino.h>
+
+#include <chrono>
+
+// Sink for results, so the compiler cannot drop the measured work
+extern volatile uint32_t benchSink;
+
+// Heap allocations made since the start of the run
+extern size_t benchAllocations;
+
+// Average cost of one call of a measured operation
+struct BenchResult {
+  double ns;          // Time per call
+  double allocations; // Heap allocations per call
+};
+
+/**
+ * Time an operation.
+ *
+ * @param iterations The number of times to call the operation.
+ * @param operation The operation, called with the iteration number.
+ * @return The average cost of one call.
+ */
+template <typename Operation>
+BenchResult benchMeasure(int iterations, Operation operation) {
+  size_t allocationsBefore = benchAllocations;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; i++) operation(i);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+
+  return {std::chrono::duration<double, std::nano>(elapsed).count() / iterations,
+          (double)(benchAllocations - allocationsBefore) / iterations};
+}
+
+/**
+ * Benchmark suites, one per file in bench/.
+ */
+void benchWsProtocol();
+void benchColourCycle();
+void benchOutput();
@@ -0,0 +1,22 @@
+#include "bench.h"
+
+#include <new>
+
+volatile uint32_t benchSink;
+size_t benchAllocations;
+
+void *operator new(size_t size) {
+  benchAllocations++;
+  void *memory = malloc(size);
+  if (!memory) throw std::bad_alloc();
+  return memory;
+}
+void operator delete(void *memory) noexcept { free(memory); }
+void operator delete(void *memory, size_t) noexcept { free(memory); }
+
+int main() {
+  benchWsProtocol();
+  benchColourCycle();
+  benchOutput();
+  return 0;
+}
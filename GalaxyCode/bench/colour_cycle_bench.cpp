@@ -0,0 +1,54 @@
+/*
+ * Host benchmark of the Cycle colour animation: the fixed-point phase accumulator and
+ * quarter-sine Q15 table (colour_cycle.h) against the floating-point sin() path it replaced,
+ * per rendered frame, and the table's error against sin().
+ *
+ * The host has a hardware FPU for double, which the ESP32 does not, so the gap on the device
+ * is wider than the one measured here.
+ */
+#include <math.h>
+
+#include "bench.h"
+#include "colour_cycle.h"
+
+// Frames rendered by each measurement
+#define CYCLE_BENCH_FRAMES 2000000
+
+// Phase step of the error scan; odd, so every table interval and fraction is visited
+#define CYCLE_ERROR_STEP 997
+
+/**
+ * Print the average cost of rendering a frame.
+ */
+template <typename Operation>
+static void benchFrame(const char *name, Operation operation) {
+  BenchResult result = benchMeasure(CYCLE_BENCH_FRAMES, operation);
+  Serial.printf("%-32s %8.1f ns/frame %6.1f allocs\n", name, result.ns, result.allocations);
+}
+
+void benchColourCycle() {
+  Serial.println("Cycle animation: red, green and blue of one frame");
+
+  // The original animation, with the frame number standing in for millis()
+  benchFrame("float sin()", [](int i) {
+    uint8_t red = 127.5 * (1 + sin(i / 1000.0));
+    uint8_t green = 127.5 * (1 + sin(i / 1000.0 + 2 * PI / 3));
+    uint8_t blue = 127.5 * (1 + sin(i / 1000.0 + 4 * PI / 3));
+    benchSink = benchSink + red + green + blue;
+  });
+
+  ColourCycle cycle = {0, 0, COLOUR_CYCLE_PHASE_PER_MS};
+  benchFrame("phase accumulator + Q15 table", [&](int i) {
+    uint16_t red, green, blue;
+    colourCycleAdvance(cycle, i);
+    colourCycleRender(cycle, red, green, blue);
+    benchSink = benchSink + red + green + blue;
+  });
+
+  double maxError = 0;
+  for (uint64_t phase = 0; phase < (1ULL << 32); phase += CYCLE_ERROR_STEP) {
+    double error = fabs(sineQ15((uint32_t)phase) - 32767.0 * sin(2 * PI * phase / 4294967296.0));
+    if (error > maxError) maxError = error;
+  }
+  Serial.printf("sineQ15 max error                %8.2f LSB (Q15)\n", maxError);
+}
@@ -0,0 +1,68 @@
+/*
+ * Host benchmark of the per-frame brightness and output path: the perceptual level to linear
+ * multiplier lookup (brightness.h), scaling the colour channels by it, and committing the
+ * frame with rounding or sigma-delta dithering (output_driver.h).
+ *
+ * The commit writes to the NativeHal LEDC shim, which only stores the duty, so this measures
+ * the driver's own work rather than the register writes on the device.
+ */
+#include "bench.h"
+#include "brightness.h"
+#include "output_driver.h"
+
+// Frames committed by each measurement
+#define OUTPUT_BENCH_FRAMES 2000000
+
+// Any distinct GPIOs will do
+static const uint8_t BENCH_PINS[ChannelLast] = {19, 17, 21, 18, 27, 4};
+
+/**
+ * Print the average cost of a frame.
+ */
+template <typename Operation>
+static void benchFrame(const char *name, Operation operation) {
+  BenchResult result = benchMeasure(OUTPUT_BENCH_FRAMES, operation);
+  Serial.printf("%-32s %8.1f ns/frame %6.1f allocs\n", name, result.ns, result.allocations);
+}
+
+/**
+ * Scale the colour channels of a frame by a linear brightness multiplier, as the effects do.
+ * Every frame has different levels, so no channel is skipped as unchanged.
+ */
+static void scaleFrame(OutputFrame &frame, int i, uint32_t brightness) {
+  for (int channel = RedChannel; channel <= WhiteChannel; channel++) {
+    uint32_t level = (i * (channel + 3)) & 0xFFFF;
+    frame.levels[channel] = (level * brightness) >> 16;
+  }
+}
+
+void benchOutput() {
+  Serial.println("Brightness and output: one frame of four colour channels");
+
+  outputBegin(BENCH_PINS);
+  OutputFrame frame = {};
+
+  benchFrame("gamma lookup", [](int i) {
+    benchSink = benchSink + brightnessLevelToScale(i & 0xFFFF);
+  });
+
+  benchFrame("gamma + scale", [&](int i) {
+    scaleFrame(frame, i, brightnessLevelToScale(i & 0xFFFF));
+    benchSink = benchSink + frame.levels[RedChannel];
+  });
+
+  benchFrame("scale + rounded commit", [&](int i) {
+    scaleFrame(frame, i, BRIGHTNESS_SCALE_MAX);
+    outputCommit(frame, false);
+  });
+
+  benchFrame("scale + dithered commit", [&](int i) {
+    scaleFrame(frame, i, BRIGHTNESS_SCALE_MAX);
+    outputCommit(frame, true);
+  });
+
+  benchFrame("gamma + scale + dithered commit", [&](int i) {
+    scaleFrame(frame, i, brightnessLevelToScale(i & 0xFFFF));
+    outputCommit(frame, true);
+  });
+}
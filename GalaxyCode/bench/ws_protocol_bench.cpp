@@ -0,0 +1,130 @@
+/*
+ * Host benchmark of the WebSocket protocols: the cost of encoding a state push and of
+ * decoding and queueing a client request, the heap allocations each makes and the bytes each
+ * puts on the wire, for the JSON text protocol and the binary protocol (see ws_protocol.h).
+ */
+#include <ESPAsyncWebServer.h>
+
+#include "bench.h"
+#include "command_queue.h"
+#include "device_state.h"
+#include "ws_protocol.h"
+
+extern AsyncWebSocket ws;
+
+size_t generateJsonForStates(const DeviceState &state, char *buffer, size_t size);
+bool parseJsonForStates(const char *data, size_t length, DeviceState &state, uint8_t &fields);
+void handleTextMessage(AsyncWebSocketClient *client, uint8_t *payload, size_t length);
+void handleBinaryMessage(AsyncWebSocketClient *client, uint8_t *payload, size_t length);
+
+// Iterations of every measured operation
+#define BENCH_ITERATIONS 200000
+
+// WebSocket frame header sizes for short payloads: the server's frames are unmasked, the
+// client's carry a 4 byte mask
+#define WS_SERVER_HEADER 2
+#define WS_CLIENT_HEADER 6
+
+/**
+ * Time an operation and print its average cost, heap allocations and size on the wire.
+ *
+ * @param name The operation's name.
+ * @param payloadBytes The payload size of the frame the operation encodes or decodes.
+ * @param headerBytes The WebSocket frame header size of that frame.
+ * @param operation The operation, called BENCH_ITERATIONS times.
+ */
+template <typename Operation>
+static void bench(const char *name, size_t payloadBytes, size_t headerBytes, Operation operation) {
+  BenchResult result = benchMeasure(BENCH_ITERATIONS, operation);
+  Serial.printf("%-32s %8.1f ns %6.1f allocs %6zu payload bytes %6zu wire bytes\n", name, result.ns,
+                result.allocations, payloadBytes, payloadBytes + headerBytes);
+}
+
+/**
+ * Empty the command queue, standing in for the state owner.
+ */
+static void drainCommands() {
+  Command command;
+  while (commandReceive(command)) benchSink = benchSink + command.value;
+}
+
+void benchWsProtocol() {
+  commandQueueBegin();
+
+  DeviceState state = {};
+  state.colour = RGBWStateEnum::Cycle;
+  state.brightnessLevel = 0x8000;
+  state.customBrightness = true;
+  state.fadeMs = 400;
+
+  DeviceState changed = state;
+  changed.colour = RGBWStateEnum::Red;
+
+  Serial.println("Server to client: state push");
+
+  char json[128];
+  size_t jsonLength = generateJsonForStates(state, json, sizeof(json));
+  bench("json full state", jsonLength, WS_SERVER_HEADER, [&](int i) {
+    benchSink = benchSink + generateJsonForStates(i & 1 ? state : changed, json, sizeof(json));
+  });
+
+  uint8_t frame[WS_BINARY_MAX_FRAME];
+  size_t fullLength = wsBinaryEncodeState(state, 1, STATE_FIELDS_ALL, frame);
+  bench("binary full state", fullLength, WS_SERVER_HEADER, [&](int i) {
+    benchSink = benchSink + wsBinaryEncodeState(i & 1 ? state : changed, i, STATE_FIELDS_ALL, frame);
+  });
+
+  size_t deltaLength = wsBinaryEncodeState(changed, 1, wsStateFieldsChanged(state, changed), frame);
+  bench("binary delta (diff + encode)", deltaLength, WS_SERVER_HEADER, [&](int i) {
+    const DeviceState &previous = i & 1 ? state : changed;
+    const DeviceState &current = i & 1 ? changed : state;
+    benchSink = benchSink + wsBinaryEncodeState(current, i, wsStateFieldsChanged(previous, current), frame);
+  });
+
+  Serial.println("Client to server: decode and queue a request");
+
+  AsyncWebSocketClient client(&ws, 1);
+
+  char colour[] = "Colour";
+  bench("text increment", strlen(colour), WS_CLIENT_HEADER, [&](int) {
+    handleTextMessage(&client, (uint8_t *)colour, strlen(colour));
+    drainCommands();
+  });
+
+  char level[] = "Brightness:50";
+  bench("text set level", strlen(level), WS_CLIENT_HEADER, [&](int) {
+    handleTextMessage(&client, (uint8_t *)level, strlen(level));
+    drainCommands();
+  });
+
+  // Parse the full state document written above
+  generateJsonForStates(state, json, sizeof(json));
+  bench("json parse state", jsonLength, WS_CLIENT_HEADER, [&](int) {
+    DeviceState parsed = {};
+    uint8_t fields;
+    benchSink = benchSink + parseJsonForStates(json, jsonLength, parsed, fields) + fields;
+  });
+
+  CommandTypeEnum command;
+  uint32_t value;
+  bench("text decode only", strlen(level), WS_CLIENT_HEADER, [&](int) {
+    benchSink = benchSink + wsTextDecodeRequest((uint8_t *)level, strlen(level), command, value) + value;
+  });
+
+  uint8_t increment[] = {IncrementOperation << 4 | ColourField, 1};
+  bench("binary increment", sizeof(increment), WS_CLIENT_HEADER, [&](int) {
+    handleBinaryMessage(&client, increment, sizeof(increment));
+    drainCommands();
+  });
+
+  uint8_t set[] = {SetOperation << 4 | BrightnessLevelField, 0x00, 0x80};
+  bench("binary set level", sizeof(set), WS_CLIENT_HEADER, [&](int) {
+    handleBinaryMessage(&client, set, sizeof(set));
+    drainCommands();
+  });
+
+  BinaryRequest request;
+  bench("binary decode only", sizeof(set), WS_CLIENT_HEADER, [&](int) {
+    benchSink = benchSink + wsBinaryDecodeRequest(set, sizeof(set), request) + request.value;
+  });
+}
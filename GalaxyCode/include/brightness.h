@@ -0,0 +1,84 @@
+#pragma once
+
+#include <Arduino.h>
+
+/*
+ * Perceptual brightness stage.
+ *
+ * Brightness is set as a perceptual level (CIE 1976 lightness L*, 0-65535 for 0-100%) and
+ * converted to a linear luminance multiplier through a lookup table, so equal steps in level
+ * look like equal steps in brightness. Small linear multipliers then get most of the output
+ * resolution, which is what removes the visible banding at low brightness.
+ */
+
+// Perceptual brightness level that represents 100%
+#define BRIGHTNESS_LEVEL_MAX 0xFFFF
+
+// Linear brightness multiplier that represents 100%, in 16.16 fixed point
+#define BRIGHTNESS_SCALE_MAX 0x10000UL
+
+// Number of intervals in the lightness to luminance table
+#define GAMMA_TABLE_SIZE 256
+
+// Linear luminance multipliers (16.16 fixed point) at GAMMA_TABLE_SIZE + 1 evenly spaced
+// lightness levels, including both 0% and 100%
+struct GammaTable {
+  uint32_t scales[GAMMA_TABLE_SIZE + 1];
+};
+
+/**
+ * Build the lightness to luminance table at compile time from the CIE L* definition:
+ * Y = ((L* + 16) / 116)^3 above L* = 8, and Y = L* / 903.3 below it.
+ */
+constexpr GammaTable makeGammaTable() {
+  GammaTable table = {};
+  for (int i = 0; i <= GAMMA_TABLE_SIZE; i++) {
+    double lightness = 100.0 * i / GAMMA_TABLE_SIZE;
+    double cubeRoot = (lightness + 16) / 116;
+    double luminance = lightness > 8 ? cubeRoot * cubeRoot * cubeRoot : lightness / 903.3;
+    table.scales[i] = static_cast<uint32_t>(luminance * BRIGHTNESS_SCALE_MAX + 0.5);
+  }
+  return table;
+}
+
+inline constexpr GammaTable GAMMA_TABLE = makeGammaTable();
+
+/**
+ * Check at compile time that the table starts at 0, ends at full scale and never decreases.
+ */
+constexpr bool gammaTableIsMonotonic(const GammaTable &table) {
+  if (table.scales[0] != 0 || table.scales[GAMMA_TABLE_SIZE] != BRIGHTNESS_SCALE_MAX) return false;
+  for (int i = 1; i <= GAMMA_TABLE_SIZE; i++) {
+    if (table.scales[i] < table.scales[i - 1]) return false;
+  }
+  return true;
+}
+
+static_assert(gammaTableIsMonotonic(GAMMA_TABLE), "Brightness gamma table must be monotonic");
+
+/**
+ * Convert a perceptual brightness level to a linear brightness multiplier.
+ *
+ * Interpolates linearly between the table entries either side of the level. Since the table
+ * is monotonic, so is the result.
+ *
+ * @param level The perceptual brightness level (0-BRIGHTNESS_LEVEL_MAX).
+ * @return The linear multiplier in 16.16 fixed point (0-BRIGHTNESS_SCALE_MAX).
+ */
+constexpr uint32_t brightnessLevelToScale(uint16_t level) {
+  uint32_t index = level >> 8;
+  uint32_t fraction = level & 0xFF;
+  uint32_t low = GAMMA_TABLE.scales[index];
+  uint32_t high = GAMMA_TABLE.scales[index + 1];
+
+  // The top level maps exactly to full scale rather than 255/256 of the last interval
+  if (level == BRIGHTNESS_LEVEL_MAX) return BRIGHTNESS_SCALE_MAX;
+  return low + (((high - low) * fraction) >> 8);
+}
+
+/**
+ * Convert a brightness percentage to a perceptual brightness level.
+ */
+constexpr uint16_t brightnessLevelFromPercent(uint32_t percent) {
+  return percent >= 100 ? BRIGHTNESS_LEVEL_MAX : percent * BRIGHTNESS_LEVEL_MAX / 100;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Phase increment per millisecond for one full colour cycle every 2*pi seconds, matching the
+// original sin(millis() / 1000.0) animation (2^32 / 6283.185 ms)
+#define COLOUR_CYCLE_PHASE_PER_MS 683565UL
+
+// Phase offsets of the green and blue channels (1/3 and 2/3 of a turn)
+#define COLOUR_CYCLE_GREEN_OFFSET 0x55555555UL
+#define COLOUR_CYCLE_BLUE_OFFSET 0xAAAAAAABUL
+
+// State of the Cycle colour animation
+struct ColourCycle {
+  uint32_t phase;       // Current phase, a full turn is 2^32
+  uint32_t lastMillis;  // Timestamp the phase was last advanced to
+  uint32_t phasePerMs;  // Phase increment per millisecond, sets the speed
+};
+
+/**
+ * Look up sin(2*pi * phase / 2^32) in Q15 fixed point.
+ *
+ * Uses a 257-entry quarter-wave table (10-bit phase resolution across the full turn) with
+ * linear interpolation on the next 8 phase bits.
+ *
+ * @param phase The phase angle, where 2^32 is a full turn.
+ * @return The sine scaled to -32767..32767.
+ */
+int32_t sineQ15(uint32_t phase);
+
+/**
+ * Advance the cycle's phase accumulator to the given time.
+ *
+ * @param cycle The colour cycle to advance.
+ * @param nowMillis The frame timestamp in milliseconds.
+ */
+void colourCycleAdvance(ColourCycle &cycle, uint32_t nowMillis);
+
+/**
+ * Compute the red, green and blue output levels for the cycle's current phase.
+ *
+ * All three channels are derived from the same phase, so they can never skew against each
+ * other. The levels are full scale (0-65534) before brightness is applied.
+ *
+ * @param cycle The colour cycle to render.
+ * @param red Receives the red level.
+ * @param green Receives the green level.
+ * @param blue Receives the blue level.
+ */
+void colourCycleRender(const ColourCycle &cycle, uint16_t &red, uint16_t &green, uint16_t &blue);
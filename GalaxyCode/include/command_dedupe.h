@@ -0,0 +1,50 @@
+#pragma once
+
+#include <Arduino.h>
+
+/*
+ * Duplicate detection for sequenced commands.
+ *
+ * A client that tags its commands with its own id and a sequence number can resend a command
+ * it has no acknowledgement for, e.g. after a reconnect, without it being applied twice. For
+ * each client id a sliding window remembers the highest sequence number seen and which of the
+ * DEDUPE_WINDOW numbers below it have been seen, so commands that arrive out of order are
+ * still accepted once. Client ids outlive WebSocket connections; the least recently used one
+ * is forgotten when the table is full.
+ */
+
+// Number of client ids remembered
+#ifndef DEDUPE_CLIENTS
+#define DEDUPE_CLIENTS 8
+#endif
+
+// Number of sequence numbers below the highest one that are tracked individually (at most 32)
+#ifndef DEDUPE_WINDOW
+#define DEDUPE_WINDOW 32
+#endif
+
+static_assert(DEDUPE_WINDOW <= 32, "DEDUPE_WINDOW must fit in a 32-bit bitmap");
+
+enum DedupeResultEnum {
+  DedupeNew,       // First time the sequence number is seen; it is now recorded
+  DedupeDuplicate, // The sequence number has been seen before
+  DedupeStale      // The sequence number is too far behind to tell, so it is treated as seen
+};
+
+/**
+ * Check a sequenced command and record its sequence number if it is new.
+ *
+ * @param clientId The client's own id; 0 is not a valid id.
+ * @param sequence The command's sequence number, which wraps at 16 bits.
+ * @return Whether the command is new.
+ */
+DedupeResultEnum dedupeCheck(uint32_t clientId, uint16_t sequence);
+
+/**
+ * Forget a sequence number recorded by dedupeCheck(), e.g. because the command could not be
+ * queued, so a retry is accepted.
+ *
+ * @param clientId The client's own id.
+ * @param sequence The sequence number to forget.
+ */
+void dedupeForget(uint32_t clientId, uint16_t sequence);
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "device_state.h"
+
+/*
+ * Command queue between the input sources and the state owner.
+ *
+ * Switches and the web interface never change the device state themselves. They submit a
+ * command and return, and a single state-owning task applies the commands in order. Each
+ * source class has its own bounded lock-free multi-producer/single-consumer ring (Vyukov's
+ * bounded queue), and the owner always drains the switch ring first, so a physical press is
+ * never stuck behind a burst of network traffic. A full ring drops the command rather than
+ * blocking the producer.
+ */
+
+// Capacity of each command ring, must be a power of two
+#ifndef COMMAND_QUEUE_SIZE
+#define COMMAND_QUEUE_SIZE 16
+#endif
+
+static_assert((COMMAND_QUEUE_SIZE & (COMMAND_QUEUE_SIZE - 1)) == 0, "COMMAND_QUEUE_SIZE must be a power of two");
+
+// Number of state patches that can be waiting for the state owner at once
+#ifndef STATE_PATCH_SLOTS
+#define STATE_PATCH_SLOTS 4
+#endif
+
+// Everything that can be asked of the state owner
+enum CommandTypeEnum {
+  PowerCommand,           // Step the power state (value is the signed number of steps)
+  BrightnessCommand,      // Step the brightness state (value is the signed number of steps)
+  ColourCommand,          // Step the colour state (value is the signed number of steps)
+  MotorCommand,           // Step the motor state (value is the signed number of steps)
+  SetPowerCommand,        // Set the power state (value is the state)
+  SetBrightnessCommand,   // Set the brightness state (value is the state)
+  SetColourCommand,       // Set the colour state (value is the state)
+  SetMotorCommand,        // Set the motor state (value is the state)
+  BrightnessLevelCommand, // Set a continuous brightness level (value is the perceptual level)
+  BrightnessRampCommand,  // Move the continuous brightness level (value is the signed change)
+  FadeCommand,            // Set the crossfade duration (value is in milliseconds)
+  GetStatesCommand,       // Send the current state to the WebSocket clients
+  PatchStateCommand,      // Set several fields as one state change (value is a patch slot)
+  CommandLast
+};
+
+// Where a command came from, in priority order
+enum CommandSourceEnum {
+  SwitchSource,    // Physical switches
+  WebSocketSource, // Web interface
+  RestSource,      // HTTP API
+  CommandSourceLast
+};
+
+// Source names, as reported by the web API
+extern const char *const COMMAND_SOURCE_NAMES[CommandSourceLast];
+
+struct Command {
+  CommandTypeEnum type;
+  CommandSourceEnum source;
+  uint32_t value;      // Argument, if the command takes one
+  uint32_t enqueuedAt; // micros() timestamp of submission
+  uint32_t replyTo;    // WebSocket client to acknowledge the command to once applied, 0 for none
+  uint16_t sequence;   // The client's sequence number for the command, echoed in the ack
+};
+
+// Command statistics for one source. Submission counters are written by the source's producer
+// and the apply counters by the state owner.
+struct CommandStats {
+  uint32_t submitted;    // Commands accepted into the queue
+  uint32_t dropped;      // Commands rejected because the queue was full
+  uint32_t invalid;      // Input that did not parse as a command
+  uint32_t applied;      // Commands applied by the state owner
+  uint32_t latencyMax;   // Worst submission to application time (us)
+  uint64_t latencyTotal; // Sum of submission to application times (us), for the average
+};
+
+extern CommandStats commandStats[CommandSourceLast];
+
+// Several fields of the state to set at once
+struct StatePatch {
+  DeviceState values; // The new values of the fields in fields; other members are ignored
+  uint8_t fields;     // The fields to set, as a StateFieldEnum mask
+};
+
+/**
+ * Initialise the queues. Must be called before any command is submitted.
+ */
+void commandQueueBegin();
+
+/**
+ * Set the task that owns the state and consumes the commands. Called by the owner itself
+ * before it first drains the queues, so commands submitted earlier are not missed.
+ *
+ * @param owner The task to notify whenever a command is submitted.
+ */
+void commandQueueSetOwner(TaskHandle_t owner);
+
+/**
+ * Submit a command to the state owner. Never blocks.
+ *
+ * @param type The command.
+ * @param source The input that produced the command, which selects its queue.
+ * @param value The command's argument, if any.
+ * @param replyTo The WebSocket client to acknowledge the command to once applied, if any.
+ * @param sequence The client's sequence number for the command, if it is acknowledged.
+ * @return Whether the command was queued; false if the queue is full.
+ */
+bool commandSubmit(CommandTypeEnum type, CommandSourceEnum source, uint32_t value = 0,
+                   uint32_t replyTo = 0, uint16_t sequence = 0);
+
+/**
+ * Submit a state patch to the state owner, to be applied as a single state change. Never
+ * blocks.
+ *
+ * The patch is copied into one of STATE_PATCH_SLOTS slots and a PatchStateCommand carrying
+ * the slot is queued; the state owner takes the patch with commandTakePatch().
+ *
+ * @param patch The fields to set.
+ * @param source The input that produced the patch, which selects its queue.
+ * @return Whether the patch was queued; false if every slot or the queue is full.
+ */
+bool commandSubmitPatch(const StatePatch &patch, CommandSourceEnum source);
+
+/**
+ * Take the patch of a PatchStateCommand and free its slot. Only called by the state owner.
+ *
+ * @param command The PatchStateCommand.
+ * @param patch Receives the patch.
+ */
+void commandTakePatch(const Command &command, StatePatch &patch);
+
+/**
+ * Take the next command, highest priority source first. Only called by the state owner.
+ *
+ * @param command Receives the command.
+ * @return Whether there was a command.
+ */
+bool commandReceive(Command &command);
+
+/**
+ * Record that a command has been applied, for the latency statistics. Only called by the
+ * state owner.
+ *
+ * @param command The command that was applied.
+ */
+void commandComplete(const Command &command);
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "states.h"
+
+/*
+ * Shared device state.
+ *
+ * The state set by the switches and the web interface and rendered by the output task lives
+ * in one DeviceState, published through a seqlock. Readers on any core or task copy a
+ * consistent snapshot without blocking, retrying only if a write lands while they copy.
+ * Writers are serialised by a critical section.
+ *
+ * Every published change increments the version, so comparing versions is enough to tell
+ * whether anything changed since the last snapshot.
+ */
+
+// Everything that describes what the device should be doing
+struct DeviceState {
+  PowerStateEnum power;
+  BrightnessStateEnum brightness;
+  RGBWStateEnum colour;
+  MotorStateEnum motor;
+  uint16_t brightnessLevel;  // Continuous perceptual brightness level, used instead of the step when set
+  bool customBrightness;     // Whether brightnessLevel overrides the brightness step
+  uint16_t fadeMs;           // Crossfade duration between states, 0 switches instantly
+};
+
+// The fields of DeviceState, for addressing a subset of them as a bitmask
+enum StateFieldEnum {
+  PowerField,
+  BrightnessField,
+  ColourField,
+  MotorField,
+  CustomBrightnessField,
+  BrightnessLevelField,
+  FadeField,
+  FieldLast
+};
+
+// Mask with every field set
+#define STATE_FIELDS_ALL ((1U << FieldLast) - 1)
+
+/**
+ * Whether two states are identical.
+ */
+inline bool deviceStateEquals(const DeviceState &a, const DeviceState &b) {
+  return a.power == b.power && a.brightness == b.brightness && a.colour == b.colour &&
+         a.motor == b.motor && a.brightnessLevel == b.brightnessLevel &&
+         a.customBrightness == b.customBrightness && a.fadeMs == b.fadeMs;
+}
+
+/**
+ * Publish the initial state. Must be called before any other task touches the state.
+ *
+ * @param initial The state to start from, published as version 0.
+ */
+void deviceStateBegin(const DeviceState &initial);
+
+/**
+ * Copy a consistent snapshot of the current state.
+ *
+ * Never blocks a writer; if a write is in progress the copy is retried.
+ *
+ * @param state Receives the snapshot.
+ * @return The version of the snapshot.
+ */
+uint32_t deviceStateRead(DeviceState &state);
+
+/**
+ * The version of the most recently published state.
+ */
+uint32_t deviceStateVersion();
+
+/**
+ * Begin changing the state: enter the writer critical section and return the current state.
+ *
+ * Must be followed by deviceStateCommitUpdate() without blocking, since interrupts on the
+ * calling core are disabled in between.
+ *
+ * @return The current state, for the caller to modify.
+ */
+DeviceState deviceStateBeginUpdate();
+
+/**
+ * Publish a modified state and leave the writer critical section.
+ *
+ * An unchanged state is not published, so it does not increment the version.
+ *
+ * @param state The new state.
+ * @return The version of the published state.
+ */
+uint32_t deviceStateCommitUpdate(const DeviceState &state);
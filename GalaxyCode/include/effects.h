@@ -0,0 +1,80 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "output_driver.h"
+#include "states.h"
+
+/*
+ * Effect engine.
+ *
+ * Every colour state is rendered by an effect registered in the static EFFECTS table, which is
+ * generated from RGBW_STATES. An effect writes a whole output frame for a frame timestamp, so it
+ * may drive the projector and motor channels as well as the LEDs; channels it leaves alone keep
+ * the levels staged by the other handlers. The engine times every render in CPU cycles, so an
+ * effect that does not fit in the frame budget shows up in the effect statistics.
+ */
+
+// Everything an effect may depend on besides its own state
+struct EffectContext {
+  uint32_t nowMillis;                  // Frame timestamp in milliseconds
+  BrightnessStateEnum brightnessState; // Current brightness step
+  uint32_t brightness;                 // Linear brightness multiplier in 16.16 fixed point
+  bool customBrightness;               // Whether brightness is a continuous level rather than the step's preset
+};
+
+/**
+ * Render one frame of an effect.
+ *
+ * @param state The colour state being rendered, for effects shared by several states.
+ * @param context The frame timestamp and brightness.
+ * @param frame The output frame to render into.
+ */
+typedef void (*EffectRenderFunction)(RGBWStateEnum state, const EffectContext &context, OutputFrame &frame);
+
+// How an effect renders, and whether its output changes over time without a state change
+struct EffectKind {
+  EffectRenderFunction render;
+  bool animated;
+};
+
+// A fixed colour from the RGBW_STATES table, scaled by the brightness
+extern const EffectKind SolidEffect;
+// Red, green and blue sine waves a third of a turn apart
+extern const EffectKind ColourCycleEffect;
+
+// A registered effect
+struct Effect {
+  const char *name;
+  const EffectKind *kind;
+};
+
+// Render cost of one effect, in CPU cycles
+struct EffectStats {
+  uint32_t renders;     // Number of frames rendered
+  uint32_t minCycles;   // Cheapest render
+  uint32_t maxCycles;   // Most expensive render
+  uint64_t totalCycles; // Sum over all renders, for the average
+};
+
+// Effects indexed by RGBWStateEnum
+extern const Effect EFFECTS[LedLast];
+
+// Render cost of each effect, indexed by RGBWStateEnum. Only written by the output task.
+extern EffectStats effectStats[LedLast];
+
+/**
+ * Render the effect of a colour state into a frame and account for its cost.
+ *
+ * @param state The colour state to render.
+ * @param context The frame timestamp and brightness.
+ * @param frame The output frame to render into.
+ */
+void effectRender(RGBWStateEnum state, const EffectContext &context, OutputFrame &frame);
+
+/**
+ * Whether the effect of a colour state needs to be rendered every frame.
+ */
+inline bool effectIsAnimated(RGBWStateEnum state) {
+  return EFFECTS[state].kind->animated;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "switch_input.h"
+
+/*
+ * Gesture recogniser for the physical switches.
+ *
+ * Turns the debounced press and release transitions of each switch into gestures, using one
+ * table-driven state machine per switch. Time only enters through the timestamps passed in,
+ * so the recogniser has no dependency on the clock or the tasks and runs unchanged on the
+ * host, e.g. against the native build's virtual clock.
+ *
+ *   Tap:        press and release within GESTURE_LONG_PRESS_MS, reported on release
+ *   DoubleTap:  a second press within GESTURE_DOUBLE_PRESS_MS of a tap, reported on press
+ *   LongPress:  held for GESTURE_LONG_PRESS_MS, reported once while still held
+ *   HoldRepeat: reported every GESTURE_REPEAT_MS while the switch stays held after a LongPress
+ */
+
+// Hold time before a press becomes a long press (ms)
+#ifndef GESTURE_LONG_PRESS_MS
+#define GESTURE_LONG_PRESS_MS 600
+#endif
+
+// Time after a tap in which another press counts as a double press (ms)
+#ifndef GESTURE_DOUBLE_PRESS_MS
+#define GESTURE_DOUBLE_PRESS_MS 300
+#endif
+
+// Interval between repeats while a switch is held (ms)
+#ifndef GESTURE_REPEAT_MS
+#define GESTURE_REPEAT_MS 50
+#endif
+
+// Returned by gestureTick() when no timeout is pending
+#define GESTURE_NO_DEADLINE UINT32_MAX
+
+enum GestureEnum {
+  TapGesture,
+  DoubleTapGesture,
+  LongPressGesture,
+  HoldRepeatGesture,
+  GestureLast
+};
+
+/**
+ * Called for every recognised gesture.
+ *
+ * @param button The switch that made the gesture.
+ * @param gesture The gesture.
+ */
+typedef void (*GestureHandler)(SwitchEnum button, GestureEnum gesture);
+
+// Recogniser state for all the switches
+struct GestureRecogniser {
+  uint8_t states[SwitchLast];     // GestureStateEnum of each switch
+  uint32_t deadlines[SwitchLast]; // Time each switch's timeout expires (ms), if its state has one
+  GestureHandler handler;
+};
+
+/**
+ * Reset a recogniser with every switch released.
+ *
+ * @param recogniser The recogniser to reset.
+ * @param handler The function to call with each recognised gesture.
+ */
+void gestureBegin(GestureRecogniser &recogniser, GestureHandler handler);
+
+/**
+ * Feed a debounced switch transition to the recogniser.
+ *
+ * @param recogniser The recogniser.
+ * @param event The transition, with the time of its edge.
+ */
+void gestureSwitchEvent(GestureRecogniser &recogniser, const SwitchEvent &event);
+
+/**
+ * Fire the timeouts that have expired.
+ *
+ * @param recogniser The recogniser.
+ * @param nowMillis The current time in milliseconds.
+ * @return The time until the next pending timeout (ms), or GESTURE_NO_DEADLINE if none.
+ */
+uint32_t gestureTick(GestureRecogniser &recogniser, uint32_t nowMillis);
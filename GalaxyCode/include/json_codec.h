@@ -0,0 +1,119 @@
+#pragma once
+
+#include <Arduino.h>
+
+/*
+ * Streaming JSON writer and tokenizer.
+ *
+ * Both work in place on a caller-provided buffer and never allocate, so documents can be
+ * built and parsed on the stack of whichever task needs them. The writer emits compact JSON
+ * one member at a time; commas are inserted automatically. The tokenizer returns one value or
+ * bracket at a time, pointing into the input rather than copying it.
+ */
+
+#pragma region Writer
+struct JsonWriter {
+  char *buffer;
+  size_t size;     // Capacity of buffer, including the terminating null
+  size_t length;   // Characters written so far
+  bool needComma;  // Whether the next member or element needs a separating comma
+  bool overflow;   // Set once the document no longer fits
+};
+
+/**
+ * Start a document in a buffer.
+ *
+ * @param writer The writer to start.
+ * @param buffer The buffer to write into.
+ * @param size The size of the buffer, including room for the terminating null.
+ */
+void jsonWriterBegin(JsonWriter &writer, char *buffer, size_t size);
+
+/**
+ * Null-terminate the document.
+ *
+ * @param writer The writer.
+ * @return The length of the document, or 0 if it did not fit in the buffer.
+ */
+size_t jsonWriterEnd(JsonWriter &writer);
+
+void jsonBeginObject(JsonWriter &writer);
+void jsonEndObject(JsonWriter &writer);
+void jsonBeginArray(JsonWriter &writer);
+void jsonEndArray(JsonWriter &writer);
+
+/**
+ * Write the key of the next object member. Must be followed by exactly one value.
+ *
+ * @param writer The writer.
+ * @param key The key; written as is, so it must not need escaping.
+ */
+void jsonKey(JsonWriter &writer, const char *key);
+
+void jsonUint(JsonWriter &writer, uint32_t value);
+void jsonInt(JsonWriter &writer, int32_t value);
+void jsonBool(JsonWriter &writer, bool value);
+
+/**
+ * Write a string value, escaping quotes, backslashes and control characters.
+ */
+void jsonString(JsonWriter &writer, const char *value);
+#pragma endregion
+
+#pragma region Tokenizer
+enum JsonTokenEnum {
+  JsonObjectStartToken,
+  JsonObjectEndToken,
+  JsonArrayStartToken,
+  JsonArrayEndToken,
+  JsonColonToken,   // Between an object member's key and value
+  JsonCommaToken,   // Between object members or array elements
+  JsonStringToken,  // start and length give the raw contents between the quotes
+  JsonNumberToken,  // number holds the value; only integers are accepted
+  JsonTrueToken,
+  JsonFalseToken,
+  JsonNullToken,
+  JsonEndToken,     // End of the input
+  JsonErrorToken    // Malformed input
+};
+
+struct JsonToken {
+  JsonTokenEnum type;
+  const char *start;
+  size_t length;
+  int32_t number;
+};
+
+struct JsonTokenizer {
+  const char *data;
+  size_t length;
+  size_t position;
+};
+
+/**
+ * Start tokenizing a document. The document does not need to be null-terminated.
+ *
+ * @param tokenizer The tokenizer to start.
+ * @param data The document.
+ * @param length The length of the document.
+ */
+void jsonTokenizerBegin(JsonTokenizer &tokenizer, const char *data, size_t length);
+
+/**
+ * Read the next token.
+ *
+ * Whitespace is skipped, but colons and commas are returned as tokens, so an object reads as
+ * its opening brace, then each key, colon and value with a comma between members, then the
+ * closing brace. Callers check the order of the tokens they expect.
+ *
+ * @param tokenizer The tokenizer.
+ * @param token Receives the token.
+ * @return Whether a token was read, false at the end of the input or on malformed input.
+ */
+bool jsonNextToken(JsonTokenizer &tokenizer, JsonToken &token);
+
+/**
+ * Compare a string token with a string.
+ */
+bool jsonTokenEquals(const JsonToken &token, const char *string);
+#pragma endregion
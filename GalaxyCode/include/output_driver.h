@@ -0,0 +1,71 @@
+#pragma once
+
+#include <Arduino.h>
+
+// PWM resolution used by the LEDC channels (bits). Higher resolutions give finer brightness
+// steps at the cost of a lower maximum PWM frequency (80 MHz / 2^bits).
+#ifndef OUTPUT_PWM_RESOLUTION
+#define OUTPUT_PWM_RESOLUTION 12
+#endif
+
+static_assert(OUTPUT_PWM_RESOLUTION >= 12 && OUTPUT_PWM_RESOLUTION <= 16,
+              "OUTPUT_PWM_RESOLUTION must be between 12 and 16 bits");
+
+// PWM frequency (Hz): 5 kHz, or the highest frequency the resolution allows if lower
+#ifndef OUTPUT_PWM_FREQUENCY
+#define OUTPUT_PWM_FREQUENCY ((80000000UL >> OUTPUT_PWM_RESOLUTION) < 5000 ? (80000000UL >> OUTPUT_PWM_RESOLUTION) : 5000)
+#endif
+
+// Output levels are 16-bit regardless of the PWM resolution; 0 is off, OUTPUT_LEVEL_MAX is fully on
+#define OUTPUT_LEVEL_MAX 0xFFFF
+
+// Channels owned by the output driver, one LEDC channel each
+enum OutputChannelEnum {
+  RedChannel,
+  GreenChannel,
+  BlueChannel,
+  WhiteChannel,
+  ProjectorChannel,
+  MotorChannel,
+  ChannelLast
+};
+
+// A complete set of output levels, staged by the render path and committed together
+struct OutputFrame {
+  uint16_t levels[ChannelLast];
+};
+
+/**
+ * Configure the LEDC timer and attach one LEDC channel to each output pin.
+ *
+ * All channels share one timer so that duty changes committed together take effect on the
+ * same PWM period. All outputs start off.
+ *
+ * @param pins The GPIO driven by each channel, indexed by OutputChannelEnum.
+ */
+void outputBegin(const uint8_t (&pins)[ChannelLast]);
+
+/**
+ * Commit a frame to the outputs.
+ *
+ * The duty of every channel that differs from the previous commit is staged first, then
+ * all staged channels are latched back to back without being preempted, so they switch on
+ * the same PWM period. Committing an unchanged frame does not touch the hardware.
+ *
+ * The 16-bit levels are reduced to the PWM resolution either by rounding, or with dithering
+ * by first-order sigma-delta modulation: the part of each level below one PWM step is carried
+ * into the next frame, so averaged over consecutive frames every channel reproduces its full
+ * 16-bit level. Dithering only pays off when frames are committed continuously, i.e. while
+ * animating.
+ *
+ * @param frame The output levels to apply.
+ * @param dither Whether to dither the levels rather than round them.
+ */
+void outputCommit(const OutputFrame &frame, bool dither = false);
+
+/**
+ * Convert an 8-bit value (0-255) to an output level.
+ */
+inline uint16_t outputLevelFrom8Bit(uint8_t value) {
+  return value * 257;
+}
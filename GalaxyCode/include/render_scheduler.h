@@ -0,0 +1,52 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Default frame rate while an animated mode is active (Hz)
+#ifndef RENDER_RATE_HZ
+#define RENDER_RATE_HZ 200
+#endif
+
+// Supported frame rate range. Frames are scheduled in whole FreeRTOS ticks, so rates that
+// do not divide the tick rate are rounded to the nearest achievable period.
+#define RENDER_RATE_MIN_HZ 1
+#define RENDER_RATE_MAX_HZ configTICK_RATE_HZ
+
+// Frame timing statistics for the current (or most recent) animation run
+struct RenderStats {
+  uint32_t rateHz;          // Configured frame rate
+  uint32_t frames;          // Frames rendered on the fixed schedule
+  uint32_t missedDeadlines; // Frames that finished after the next frame was already due
+  uint32_t jitterMax;       // Worst deviation of the frame interval from the period (us)
+  uint64_t jitterTotal;     // Sum of the frame interval deviations (us), for the average
+  uint32_t frameTimeMax;    // Longest time spent rendering a frame (us)
+  uint64_t frameTimeTotal;  // Sum of frame render times (us), for the average
+};
+
+extern RenderStats renderStats;
+
+/**
+ * Set the frame rate used while an animated mode is active.
+ *
+ * @param rateHz The frame rate in Hz, clamped to RENDER_RATE_MIN_HZ..RENDER_RATE_MAX_HZ.
+ */
+void renderSchedulerSetRate(uint32_t rateHz);
+
+/**
+ * Mark the start of a frame, for frame time accounting.
+ *
+ * Called by the output task immediately before it renders.
+ */
+void renderSchedulerBeginFrame();
+
+/**
+ * Finish the current frame and block until the next one is due.
+ *
+ * While animated is true, the calling task is woken on a fixed vTaskDelayUntil schedule at
+ * the configured rate. Otherwise it blocks on its task notification and is only woken by a
+ * state change, so a static output costs no wakeups at all. A state change during an
+ * animation is picked up on the next frame.
+ *
+ * @param animated Whether the output needs to be re-rendered continuously.
+ */
+void renderSchedulerWait(bool animated);
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "brightness.h"
+#include "output_driver.h"
+
+/*
+ * Single definition of every device state.
+ *
+ * Each list below is an X-macro: one X(...) entry per state, in enum order. The firmware's
+ * state enums and constant output tables are generated from these lists, and so is the web
+ * UI's statesDict (see STATES_DICT_ENTRY), so the two can never drift apart. The first two
+ * columns of every list are the state's name and its emoji in the web UI.
+ */
+
+// X(name, emoji)
+#define POWER_STATES(X) \
+  X(PowerOff, "🌑") \
+  X(On,       "🌓") \
+  X(Project,  "🌕")
+
+// X(name, emoji, percent): percent is the perceptual brightness (lightness) of the step
+#define BRIGHTNESS_STATES(X) \
+  X(ExtraLow, "🌒", 25) \
+  X(Low,      "🌓", 50) \
+  X(Medium,   "🌔", 75) \
+  X(High,     "🌕", 100)
+
+// X(name, emoji, red, green, blue, white, effect): channel intensities are 0-255, effect is
+// the EffectKind that renders the state (see effects.h)
+#define RGBW_STATES(X) \
+  X(Blue,              "🔵",   0,   0, 255,   0, SolidEffect) \
+  X(Red,               "🔴", 255,   0,   0,   0, SolidEffect) \
+  X(Green,             "🟢",   0, 255,   0,   0, SolidEffect) \
+  X(White,             "⚪️",   0,   0,   0, 255, SolidEffect) \
+  X(BlueRed,           "🔵🔴", 255,   0, 255,   0, SolidEffect) \
+  X(BlueGreen,         "🔵🟢",   0, 255, 255,   0, SolidEffect) \
+  X(RedGreen,          "🔴🟢", 255, 255,   0,   0, SolidEffect) \
+  X(RedWhite,          "🔴⚪️", 255,   0,   0, 255, SolidEffect) \
+  X(GreenWhite,        "🟢⚪️",   0, 255,   0, 255, SolidEffect) \
+  X(RedGreenBlue,      "🔴🟢🔵", 255, 255, 255,   0, SolidEffect) \
+  X(BlueGreenWhite,    "🔵🟢⚪️",   0, 255, 255, 255, SolidEffect) \
+  X(BlueRedGreenWhite, "🔵🔴🟢⚪️", 255, 255, 255, 255, SolidEffect) \
+  X(Cycle,             "🔄",   0,   0,   0,   0, ColourCycleEffect)
+
+// X(name, emoji, speed): speed is the motor duty, 0-255
+#define MOTOR_STATES(X) \
+  X(MotorOff, "🛑",   0) \
+  X(Fast,     "🐇", 255) \
+  X(Slow,     "🐢", 200)
+
+#pragma region State Enumerations
+#define STATE_ENUM_ENTRY(name, ...) name,
+
+enum PowerStateEnum {
+  POWER_STATES(STATE_ENUM_ENTRY)
+  PowerLast
+};
+
+enum BrightnessStateEnum {
+  BRIGHTNESS_STATES(STATE_ENUM_ENTRY)
+  BrightnessLast
+};
+
+enum RGBWStateEnum {
+  RGBW_STATES(STATE_ENUM_ENTRY)
+  LedLast
+};
+
+enum MotorStateEnum {
+  MOTOR_STATES(STATE_ENUM_ENTRY)
+  MotorLast
+};
+#pragma endregion
+
+#pragma region State Tables
+// Perceptual brightness levels indexed by BrightnessStateEnum
+#define BRIGHTNESS_LEVEL_ENTRY(name, emoji, percent) brightnessLevelFromPercent(percent),
+constexpr uint16_t BRIGHTNESS_LEVELS[BrightnessLast] = {BRIGHTNESS_STATES(BRIGHTNESS_LEVEL_ENTRY)};
+
+// Linear brightness multipliers indexed by BrightnessStateEnum, in 16.16 fixed point
+#define BRIGHTNESS_SCALE_ENTRY(name, emoji, percent) brightnessLevelToScale(brightnessLevelFromPercent(percent)),
+constexpr uint32_t BRIGHTNESS_SCALES[BrightnessLast] = {BRIGHTNESS_STATES(BRIGHTNESS_SCALE_ENTRY)};
+
+// Motor output levels indexed by MotorStateEnum
+#define MOTOR_LEVEL_ENTRY(name, emoji, speed) speed * 257,
+constexpr uint16_t MOTOR_LEVELS[MotorLast] = {MOTOR_STATES(MOTOR_LEVEL_ENTRY)};
+
+// Channel intensities (red, green, blue, white; 0-255) indexed by RGBWStateEnum
+#define RGBW_COLOUR_ENTRY(name, emoji, red, green, blue, white, effect) {red, green, blue, white},
+constexpr uint8_t RGBW_COLOURS[LedLast][4] = {RGBW_STATES(RGBW_COLOUR_ENTRY)};
+
+// RGBW output levels of one palette entry
+struct RGBWLevels {
+  uint16_t red;
+  uint16_t green;
+  uint16_t blue;
+  uint16_t white;
+};
+
+// Output levels of every RGBW state at every brightness level
+struct PaletteTable {
+  RGBWLevels levels[LedLast][BrightnessLast];
+};
+
+/**
+ * Build the palette table at compile time.
+ *
+ * Each 0-255 channel intensity is expanded to a 16-bit output level and scaled by the
+ * gamma-corrected multiplier of each brightness step, so rendering a static colour is a
+ * single table lookup. States without a colour (such as Cycle) are left at zero.
+ */
+constexpr PaletteTable makePaletteTable() {
+  PaletteTable table = {};
+  for (int c = 0; c < LedLast; c++) {
+    for (int b = 0; b < BrightnessLast; b++) {
+      uint32_t scale = BRIGHTNESS_SCALES[b];
+      table.levels[c][b] = {
+        static_cast<uint16_t>((RGBW_COLOURS[c][0] * 257u * scale) >> 16),
+        static_cast<uint16_t>((RGBW_COLOURS[c][1] * 257u * scale) >> 16),
+        static_cast<uint16_t>((RGBW_COLOURS[c][2] * 257u * scale) >> 16),
+        static_cast<uint16_t>((RGBW_COLOURS[c][3] * 257u * scale) >> 16)};
+    }
+  }
+  return table;
+}
+
+constexpr PaletteTable PALETTE_TABLE = makePaletteTable();
+#pragma endregion
+
+// Expands to a JavaScript array element holding the state's emoji, for building statesDict
+#define STATES_DICT_ENTRY(name, emoji, ...) "'" emoji "', "
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <Arduino.h>
+
+/*
+ * Interrupt-driven switch input.
+ *
+ * Every edge on a switch pin raises a GPIO interrupt that timestamps the edge and queues it;
+ * nothing polls the pins. A press is reported on its first edge, so the press latency is the
+ * interrupt latency. Each switch has its own debounce state machine: after a release edge the
+ * switch's own esp_timer waits out the bounce before the release is reported, and an edge
+ * back to pressed in that window is treated as bounce. One switch's release can never mask
+ * another switch's press.
+ */
+
+// Time a switch must stay released before the release is accepted (ms)
+#ifndef SWITCH_DEBOUNCE_MS
+#define SWITCH_DEBOUNCE_MS 100
+#endif
+
+// Capacity of the edge queue between the interrupts and the input task
+#ifndef SWITCH_EVENT_QUEUE_SIZE
+#define SWITCH_EVENT_QUEUE_SIZE 32
+#endif
+
+// The physical switches
+enum SwitchEnum {
+  MotorSwitch,
+  BrightnessSwitch,
+  ColourSwitch,
+  StateSwitch,
+  SwitchLast
+};
+
+// A debounced switch transition
+struct SwitchEvent {
+  SwitchEnum button;
+  bool pressed;        // True for a press, false for a release
+  uint32_t timeMillis; // Time of the edge that started the transition, on the millis() clock
+};
+
+/**
+ * Configure the switch pins as active-low inputs and attach their edge interrupts.
+ *
+ * @param pins The GPIO of each switch, indexed by SwitchEnum.
+ */
+void switchInputBegin(const uint8_t (&pins)[SwitchLast]);
+
+/**
+ * Wait for a switch to be pressed or released.
+ *
+ * Runs the debounce state machines on the queued edges and timer expiries, and returns the
+ * first debounced transition. Must only be called from one task.
+ *
+ * @param event Receives the transition.
+ * @param ticksToWait How long to wait for a queued edge or timer expiry, or portMAX_DELAY.
+ * @return Whether a transition was received.
+ */
+bool switchInputReceive(SwitchEvent &event, TickType_t ticksToWait = portMAX_DELAY);
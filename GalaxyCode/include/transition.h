@@ -0,0 +1,62 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "output_driver.h"
+
+// Default crossfade duration between states (ms)
+#ifndef TRANSITION_DURATION_MS
+#define TRANSITION_DURATION_MS 400
+#endif
+
+// Easing curves for the crossfade progress
+enum TransitionEasingEnum {
+  LinearEasing,  // Constant speed
+  SmoothEasing,  // Smoothstep: eases in and out, 3t^2 - 2t^3
+  EaseOutEasing, // Fast start, gentle finish: 1 - (1 - t)^2
+  EasingLast
+};
+
+// A crossfade from one output frame to the (possibly moving) target frame
+struct Transition {
+  OutputFrame from;             // Frame displayed when the transition started
+  uint32_t startMillis;         // Time the transition started
+  uint32_t durationMs;          // Length of the transition, 0 switches instantly
+  TransitionEasingEnum easing;  // Progress curve
+  bool active;                  // Whether a transition is in progress
+};
+
+/**
+ * Start a transition from the frame currently displayed.
+ *
+ * Starting a new transition while one is in flight begins from the blended frame on screen,
+ * so a change of target mid-fade continues smoothly instead of jumping.
+ *
+ * @param transition The transition to start.
+ * @param displayed The frame currently on the outputs.
+ * @param nowMillis The current time in milliseconds.
+ */
+void transitionStart(Transition &transition, const OutputFrame &displayed, uint32_t nowMillis);
+
+/**
+ * Blend the frame for the current time of a transition.
+ *
+ * The target is passed every frame rather than captured at the start, so a transition into
+ * an animated mode fades into the live animation. Costs one easing evaluation plus one
+ * multiply per channel, regardless of the duration.
+ *
+ * @param transition The transition to apply; marked inactive once it completes.
+ * @param target The frame the state calls for at this time.
+ * @param nowMillis The current time in milliseconds.
+ * @param out Receives the frame to display.
+ */
+void transitionApply(Transition &transition, const OutputFrame &target, uint32_t nowMillis, OutputFrame &out);
+
+/**
+ * Evaluate an easing curve.
+ *
+ * @param easing The curve to evaluate.
+ * @param progress The linear progress in 16.16 fixed point (0-65536).
+ * @return The eased progress in 16.16 fixed point (0-65536).
+ */
+uint32_t transitionEase(TransitionEasingEnum easing, uint32_t progress);
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+/*
+ * Pool of preallocated WebSocket message buffers for state broadcasts.
+ *
+ * A broadcast serializes each distinct payload once into a pooled buffer and queues that
+ * buffer to every client it is meant for, instead of having the web server copy the payload
+ * into a new buffer per call. A buffer is free again once every message it was queued with
+ * has been deleted by the web server, i.e. sent or discarded. Buffers are only reallocated
+ * when a payload of a different length is written into them.
+ *
+ * The messages are created by the state owner and deleted by the network task, possibly on
+ * the other core, so the pool keeps its own atomic count of them. The web server's own
+ * buffer count is a plain integer updated from both tasks and is never relied on.
+ */
+
+// Number of pooled buffers; a broadcast needs one per distinct payload, and buffers still
+// queued to slow clients are skipped until they are sent
+#ifndef WS_BROADCAST_BUFFERS
+#define WS_BROADCAST_BUFFERS 6
+#endif
+
+// Length the pooled buffers are allocated with at startup
+#ifndef WS_BROADCAST_BUFFER_SIZE
+#define WS_BROADCAST_BUFFER_SIZE 64
+#endif
+
+// Buffer pool usage
+struct WsBufferStats {
+  uint32_t acquired;    // Buffers handed out
+  uint32_t allocations; // Buffer allocations, including the ones at startup
+  uint32_t exhausted;   // Acquisitions that failed because every buffer was in use or allocation failed
+};
+
+extern WsBufferStats wsBufferStats;
+
+/**
+ * Allocate the pooled buffers.
+ */
+void wsBuffersBegin();
+
+/**
+ * Take a free buffer and size it for a payload. The buffer stays reserved until it is
+ * released, and after that until every message it was queued with has been deleted.
+ *
+ * Must only be called from the state owner.
+ *
+ * @param length The length of the payload that will be written into the buffer.
+ * @return The buffer, or nullptr if every buffer is in use or the allocation failed.
+ */
+AsyncWebSocketMessageBuffer *wsBufferAcquire(size_t length);
+
+/**
+ * Release a buffer taken with wsBufferAcquire() once it has been queued to its clients.
+ *
+ * @param buffer The buffer.
+ */
+void wsBufferRelease(AsyncWebSocketMessageBuffer *buffer);
+
+/**
+ * Count a message created with a pooled buffer. Called by the message's constructor.
+ *
+ * @param buffer The buffer.
+ */
+void wsBufferAddMessage(AsyncWebSocketMessageBuffer *buffer);
+
+/**
+ * Count a message with a pooled buffer as deleted, once it no longer reads the buffer's data.
+ * Called by the message's destructor, from any task.
+ *
+ * @param buffer The buffer.
+ */
+void wsBufferRemoveMessage(AsyncWebSocketMessageBuffer *buffer);
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+#include "device_state.h"
+
+/*
+ * Per-client WebSocket sessions.
+ *
+ * Records the protocol each connected client negotiated, the id it identified itself with,
+ * the state fields it subscribed to and the state it was last sent, so every client can be
+ * sent only what it has not seen: a delta of the changed fields for binary clients, or the
+ * whole JSON document for text clients. Sessions are added and removed by the network task
+ * and read by the state owner.
+ *
+ * Every client has one state slot: while a state message is queued to it and not yet sent,
+ * it is not queued another one. The newer state waits in the session instead, replacing any
+ * state that was already waiting, and is sent as soon as the queued message has gone. A
+ * client on a slow link therefore gets the newest state next, rather than a backlog of stale
+ * ones, and its queue on the web server never fills up with states.
+ */
+
+// Maximum number of WebSocket clients with a session; matches the web server's client limit
+#ifndef WS_MAX_CLIENTS
+#define WS_MAX_CLIENTS 8
+#endif
+
+// What a client needs to be sent to catch up with the current state
+struct WsClientUpdate {
+  uint32_t id;    // WebSocket client id
+  bool binary;    // Whether the client speaks the binary protocol
+  uint8_t fields; // Fields to send, as a StateFieldEnum mask
+};
+
+// Outgoing message statistics of a session
+struct WsClientStats {
+  uint32_t id;       // WebSocket client id
+  uint8_t depth;     // Messages queued to the client and not yet sent
+  uint8_t maxDepth;  // Largest depth seen
+  bool stateQueued;  // Whether the state slot is taken
+  uint32_t queued;   // Messages queued to the client
+  uint32_t replaced; // Waiting states replaced by a newer one before they could be sent
+  uint32_t dropped;  // Messages discarded unsent, because the queue was full or the client left
+};
+
+// A state message that holds its client's state slot until it has been sent or discarded
+struct WsStateMessage : AsyncWebSocketMultiMessage {
+  WsStateMessage(uint32_t id, AsyncWebSocketMessageBuffer *buffer, bool binary);
+  ~WsStateMessage() override;
+  uint32_t clientId;
+  AsyncWebSocketMessageBuffer *buffer; // Pooled buffer (see ws_buffers.h)
+};
+
+// Any other message to a client, counted in its queue depth
+struct WsReplyMessage : AsyncWebSocketBasicMessage {
+  WsReplyMessage(uint32_t id, const uint8_t *data, size_t length, bool binary);
+  ~WsReplyMessage() override;
+  uint32_t clientId;
+};
+
+/**
+ * Set the task that sends the state updates, to be woken when a client's state slot frees
+ * up while a newer state is waiting for it.
+ *
+ * @param owner The task to notify.
+ */
+void wsClientsSetOwner(TaskHandle_t owner);
+
+/**
+ * Whether a state slot has freed up for a client with a state waiting since the last call.
+ */
+bool wsClientsTakeReady();
+
+/**
+ * Start a session for a newly connected client, subscribed to every field.
+ *
+ * @param id The WebSocket client id.
+ * @param binary Whether the client negotiated the binary protocol.
+ * @return Whether there was room for the session.
+ */
+bool wsClientAdd(uint32_t id, bool binary);
+
+/**
+ * End a client's session.
+ *
+ * @param id The WebSocket client id.
+ */
+void wsClientRemove(uint32_t id);
+
+/**
+ * Choose the fields pushed to a client.
+ *
+ * @param id The WebSocket client id.
+ * @param fields The fields to push, as a StateFieldEnum mask.
+ */
+void wsClientSubscribe(uint32_t id, uint8_t fields);
+
+/**
+ * Record the id a client identified itself with, which unlike the WebSocket client id stays
+ * the same when it reconnects.
+ *
+ * @param id The WebSocket client id.
+ * @param clientId The client's own id.
+ */
+void wsClientIdentify(uint32_t id, uint32_t clientId);
+
+/**
+ * The id a client identified itself with.
+ *
+ * @param id The WebSocket client id.
+ * @return The client's own id, or 0 if it has not identified itself.
+ */
+uint32_t wsClientIdentity(uint32_t id);
+
+/**
+ * Forget what a client was last sent, so its next update carries every subscribed field.
+ *
+ * @param id The WebSocket client id.
+ */
+void wsClientResync(uint32_t id);
+
+/**
+ * Work out what one session needs to be sent to catch up with a state, and record the state
+ * as sent. If the client's state slot is taken, the state waits for it instead. Must only be
+ * called from the state owner, which must then queue a WsStateMessage or resync the client.
+ *
+ * @param slot The session slot (0 to WS_MAX_CLIENTS - 1).
+ * @param state The current state.
+ * @param update Receives the client and the fields to send.
+ * @return Whether the slot holds a client that needs an update now.
+ */
+bool wsClientTakeUpdate(int slot, const DeviceState &state, WsClientUpdate &update);
+
+/**
+ * Copy the outgoing message statistics of one session.
+ *
+ * @param slot The session slot (0 to WS_MAX_CLIENTS - 1).
+ * @param stats Receives the statistics.
+ * @return Whether the slot holds a client.
+ */
+bool wsClientStats(int slot, WsClientStats &stats);
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "command_queue.h"
+#include "device_state.h"
+
+/*
+ * WebSocket protocols.
+ *
+ * Text protocol: each message is a command name, optionally followed by a colon and a
+ * decimal argument, e.g. "Colour" or "Brightness:42" (see TEXT_COMMANDS in ws_protocol.cpp).
+ * The server pushes the whole state as a JSON document.
+ *
+ * Binary protocol:
+ * Clients that ask for the WS_BINARY_PROTOCOL subprotocol in the WebSocket handshake talk in
+ * small binary frames instead of text. The first byte of every frame holds the operation in
+ * its high nibble and a StateFieldEnum in its low nibble; multi-byte values are little endian.
+ * The brightness level and fade duration are 16 bits, every other field 8 bits, and
+ * CustomBrightnessField is read only.
+ *
+ *   Client to server:
+ *     Set        [0x1f, value]           Set an enumerated field to an absolute value
+ *                [0x1f, lo, hi]          Set the brightness level or fade duration
+ *     Increment  [0x2f, steps]           Step an enumerated field by signed steps
+ *                [0x2f, lo, hi]          Move the brightness level by a signed amount
+ *     Subscribe  [0x30, fieldMask]       Choose the fields pushed to this client, and get
+ *                                        all of them straight away
+ *     Hello      [0x50, clientId (4 bytes)]
+ *                                        Identify the client for sequenced commands. The id
+ *                                        is the client's own, non-zero, and kept across
+ *                                        reconnects
+ *     Sequenced  [0x60, sequence (2 bytes), Set or Increment frame]
+ *                                        A command that is applied at most once however
+ *                                        often it is sent (see command_dedupe.h), and is
+ *                                        acknowledged. Needs a Hello first
+ *
+ *   Server to client:
+ *     State      [0x40, version (4 bytes), fieldMask, values...]
+ *                A state delta: the fields in fieldMask (in StateFieldEnum order) that
+ *                changed since the last push to this client, tagged with the state version.
+ *     Ack        [0x70, sequence (2 bytes), AckStatusEnum, version (4 bytes)]
+ *                The outcome of a sequenced command and the state version after it. A
+ *                command is acknowledged after the state delta it caused, so clients can
+ *                send several commands without waiting for each push, and resend the ones
+ *                they have no ack for.
+ *
+ * Clients that do not ask for the subprotocol keep using the text/JSON protocol.
+ */
+
+// Subprotocol name to request in Sec-WebSocket-Protocol; the suffix is the protocol version
+#define WS_BINARY_PROTOCOL "galaxy.v1"
+
+// Largest frame in either direction: a state push with every field (6 byte header, 9 bytes of values)
+#define WS_BINARY_MAX_FRAME 15
+
+// Length of an ack frame
+#define WS_BINARY_ACK_FRAME 8
+
+enum BinaryOperationEnum {
+  SetOperation = 0x1,
+  IncrementOperation = 0x2,
+  SubscribeOperation = 0x3,
+  StateOperation = 0x4,
+  HelloOperation = 0x5,
+  SequencedOperation = 0x6,
+  AckOperation = 0x7
+};
+
+enum AckStatusEnum {
+  AppliedAck,   // The command has been applied
+  DuplicateAck, // The command was applied before, or is too old to tell; it was not applied again
+  BusyAck,      // The command queue was full; the command may be sent again
+  InvalidAck    // The command was malformed, set a value out of range, or the client has not sent a Hello
+};
+
+// A decoded client frame
+struct BinaryRequest {
+  BinaryOperationEnum operation; // For a Sequenced frame, the operation of the frame inside it
+  CommandTypeEnum command;       // Command to submit, for Set and Increment
+  uint32_t value;                // Command argument, the field mask for Subscribe, or the client id for Hello
+  bool sequenced;                // Whether the frame was Sequenced
+  uint16_t sequence;             // The sequence number, if sequenced
+};
+
+/**
+ * Decode a binary frame from a client.
+ *
+ * @param data The frame payload.
+ * @param length The payload length in bytes.
+ * @param request Receives the decoded request. For a Sequenced frame, sequenced and sequence
+ *                are filled in even if the frame inside it is invalid, so it can be acked.
+ * @return Whether the frame is a valid request; a Set to a value outside the field's range
+ *         is not.
+ */
+bool wsBinaryDecodeRequest(const uint8_t *data, size_t length, BinaryRequest &request);
+
+/**
+ * Encode an ack.
+ *
+ * @param sequence The sequence number of the command.
+ * @param status The outcome of the command.
+ * @param version The state version after the command.
+ * @param out The buffer to encode into, at least WS_BINARY_ACK_FRAME bytes.
+ * @return The frame length in bytes.
+ */
+size_t wsBinaryEncodeAck(uint16_t sequence, AckStatusEnum status, uint32_t version, uint8_t *out);
+
+/**
+ * Bitmask of the fields that differ between two states.
+ */
+uint8_t wsStateFieldsChanged(const DeviceState &previous, const DeviceState &current);
+
+/**
+ * Encode a state push.
+ *
+ * @param state The state to send.
+ * @param version The version of the state.
+ * @param fields The fields to include.
+ * @param out The buffer to encode into, at least WS_BINARY_MAX_FRAME bytes.
+ * @return The frame length in bytes.
+ */
+size_t wsBinaryEncodeState(const DeviceState &state, uint32_t version, uint8_t fields, uint8_t *out);
+
+/**
+ * Decode a message in the text protocol, straight from the payload bytes.
+ *
+ * @param data The message payload, not null-terminated.
+ * @param length The payload length in bytes.
+ * @param command Receives the command to submit.
+ * @param value Receives the command argument; 0 for GetStatesCommand, whose argument is the
+ *              id of the client, which the caller fills in.
+ * @return Whether the message is a valid command.
+ */
+bool wsTextDecodeRequest(const uint8_t *data, size_t length, CommandTypeEnum &command, uint32_t &value);
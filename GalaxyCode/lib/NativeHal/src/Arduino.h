@@ -0,0 +1,160 @@
+#pragma once
+
+// Host shim for the subset of the Arduino-ESP32 core used by the firmware.
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <string>
+
+#include "Esp.h"
+#include "NativeHal.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define PROGMEM
+
+#define LOW 0x0
+#define HIGH 0x1
+
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+#define IRAM_ATTR
+
+#ifndef PI
+#define PI 3.1415926535897932384626433832795
+#endif
+
+#pragma region Pins and Timing
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+void analogWrite(uint8_t pin, int value);
+
+// Interrupt handlers run on the thread that calls nativeSetPinLevel()
+#define digitalPinToInterrupt(p) (p)
+void attachInterruptArg(uint8_t pin, void (*userFunc)(void *), void *arg, int mode);
+void detachInterrupt(uint8_t pin);
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+
+// The ESP32 runs at 240 MHz under the Arduino core
+inline uint32_t getCpuFrequencyMhz() { return 240; }
+
+// Hardware random number generator, from esp_system.h on the ESP32
+uint32_t esp_random();
+#pragma endregion
+
+#pragma region String
+class String {
+public:
+  String() {}
+  String(const char *cstr) : _str(cstr ? cstr : "") {}
+  String(const std::string &str) : _str(str) {}
+  explicit String(char c) : _str(1, c) {}
+  explicit String(int value) : _str(std::to_string(value)) {}
+  explicit String(unsigned int value) : _str(std::to_string(value)) {}
+  explicit String(long value) : _str(std::to_string(value)) {}
+  explicit String(unsigned long value) : _str(std::to_string(value)) {}
+
+  unsigned int length() const { return _str.length(); }
+  const char *c_str() const { return _str.c_str(); }
+  long toInt() const { return strtol(_str.c_str(), nullptr, 10); }
+
+  String &operator+=(const String &rhs) { _str += rhs._str; return *this; }
+  String &operator+=(const char *rhs) { _str += rhs; return *this; }
+  String &operator+=(char rhs) { _str += rhs; return *this; }
+
+  bool operator==(const String &rhs) const { return _str == rhs._str; }
+  bool operator==(const char *rhs) const { return _str == rhs; }
+  bool operator!=(const String &rhs) const { return _str != rhs._str; }
+  bool operator!=(const char *rhs) const { return _str != rhs; }
+  bool equalsIgnoreCase(const String &rhs) const { return strcasecmp(_str.c_str(), rhs.c_str()) == 0; }
+  int indexOf(const String &str) const {
+    size_t index = _str.find(str._str);
+    return index == std::string::npos ? -1 : (int)index;
+  }
+
+  bool startsWith(const char *prefix) const { return _str.compare(0, strlen(prefix), prefix) == 0; }
+  String substring(unsigned int from) const { return from < _str.length() ? String(_str.substr(from)) : String(); }
+  String substring(unsigned int from, unsigned int to) const {
+    if (to > _str.length()) to = _str.length();
+    return from < to ? String(_str.substr(from, to - from)) : String();
+  }
+
+private:
+  std::string _str;
+};
+#pragma endregion
+
+#pragma region Serial
+class Printable {
+public:
+  virtual ~Printable() {}
+  virtual String toString() const = 0;
+};
+
+class HardwareSerial {
+public:
+  void begin(unsigned long baud) { (void)baud; }
+
+  size_t print(const char *str) { return fputs(str, stdout) >= 0 ? strlen(str) : 0; }
+  size_t print(const String &str) { return print(str.c_str()); }
+  size_t print(const Printable &p) { return print(p.toString()); }
+  size_t print(char c) { return putchar(c) == EOF ? 0 : 1; }
+  size_t print(int value) { return printf("%d", value); }
+  size_t print(unsigned int value) { return printf("%u", value); }
+  size_t print(long value) { return printf("%ld", value); }
+  size_t print(unsigned long value) { return printf("%lu", value); }
+  size_t print(double value) { return printf("%.2f", value); }
+
+  size_t println() { return print('\n'); }
+  template <typename T>
+  size_t println(const T &value) { size_t n = print(value); return n + println(); }
+
+  size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3))) {
+    va_list args;
+    va_start(args, format);
+    int n = vprintf(format, args);
+    va_end(args);
+    return n < 0 ? 0 : n;
+  }
+};
+
+extern HardwareSerial Serial;
+#pragma endregion
+
+#pragma region IPAddress
+class IPAddress : public Printable {
+public:
+  IPAddress() : IPAddress(0, 0, 0, 0) {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : _octets{a, b, c, d} {}
+
+  String toString() const override {
+    char buffer[16];
+    snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u", _octets[0], _octets[1], _octets[2], _octets[3]);
+    return String(buffer);
+  }
+
+private:
+  uint8_t _octets[4];
+};
+#pragma endregion
+
+// Sketch entry points, called by the host main()
+void setup();
+void loop();
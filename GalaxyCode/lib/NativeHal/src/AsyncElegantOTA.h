@@ -0,0 +1,14 @@
+#pragma once
+
+// Host shim for AsyncElegantOTA. OTA updates are not available off-device.
+
+#include <ESPAsyncWebServer.h>
+
+class AsyncElegantOtaClass {
+public:
+  void begin(AsyncWebServer *server, const char *username = "", const char *password = "") {
+    (void)server; (void)username; (void)password;
+  }
+};
+
+extern AsyncElegantOtaClass AsyncElegantOTA;
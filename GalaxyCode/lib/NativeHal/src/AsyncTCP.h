@@ -0,0 +1,7 @@
+#pragma once
+
+// Host shim for AsyncTCP. The firmware only uses it indirectly through ESPAsyncWebServer.
+
+#include <Arduino.h>
+
+class AsyncClient {};
@@ -0,0 +1,490 @@
+#pragma once
+
+// Host shim for the subset of ESPAsyncWebServer used by the firmware.
+//
+// There is no network stack behind it: a harness drives the WebSocket by calling
+// nativeConnect()/nativeReceive() and observes outgoing messages through nativeOnSend().
+
+#include <Arduino.h>
+#include <AsyncTCP.h>
+
+#include <functional>
+#include <initializer_list>
+#include <list>
+#include <utility>
+
+typedef enum {
+  HTTP_GET = 0b00000001,
+  HTTP_POST = 0b00000010,
+  HTTP_DELETE = 0b00000100,
+  HTTP_PUT = 0b00001000,
+  HTTP_PATCH = 0b00010000,
+  HTTP_HEAD = 0b00100000,
+  HTTP_OPTIONS = 0b01000000,
+  HTTP_ANY = 0b01111111,
+} WebRequestMethod;
+
+typedef uint8_t WebRequestMethodComposite;
+
+class AsyncWebHeader {
+public:
+  AsyncWebHeader(const String &name, const String &value) : _name(name), _value(value) {}
+
+  const String &name() const { return _name; }
+  const String &value() const { return _value; }
+
+private:
+  String _name;
+  String _value;
+};
+
+class AsyncWebServerResponse {
+public:
+  AsyncWebServerResponse(int code, const String &contentType, const String &content)
+    : _code(code), _contentType(contentType), _content(content) {}
+
+  void addHeader(const String &name, const String &value) { _headers.emplace_back(name, value); }
+
+  int nativeCode() const { return _code; }
+  const String &nativeContent() const { return _content; }
+  const std::list<AsyncWebHeader> &nativeHeaders() const { return _headers; }
+
+private:
+  int _code;
+  String _contentType;
+  String _content;
+  std::list<AsyncWebHeader> _headers;
+};
+
+class AsyncWebServerRequest {
+public:
+  WebRequestMethodComposite method() const { return _method; }
+  size_t contentLength() const { return _contentLength; }
+  const String &contentType() const { return _contentType; }
+
+  bool hasHeader(const String &name) const { return getHeader(name) != nullptr; }
+
+  AsyncWebHeader *getHeader(const String &name) const {
+    for (auto &header : _headers) {
+      if (header.name().equalsIgnoreCase(name)) return const_cast<AsyncWebHeader *>(&header);
+    }
+    return nullptr;
+  }
+
+  // Like the real server, the content type is also kept without its parameters
+  void nativeAddHeader(const String &name, const String &value) {
+    _headers.emplace_back(name, value);
+    if (name.equalsIgnoreCase("Content-Type")) _contentType = value.substring(0, value.indexOf(";"));
+  }
+  void nativeSetMethod(WebRequestMethodComposite method) { _method = method; }
+  void nativeSetContentLength(size_t length) { _contentLength = length; }
+
+  void send_P(int code, const String &contentType, const char *content) {
+    (void)contentType; (void)content;
+    _responseCode = code;
+  }
+
+  void send(int code, const String &contentType = String(), const String &content = String()) {
+    (void)contentType;
+    _responseCode = code;
+    _responseBody = content;
+  }
+
+  // Like the real server, the request takes ownership of the response
+  AsyncWebServerResponse *beginResponse(int code, const String &contentType = String(), const String &content = String()) {
+    return new AsyncWebServerResponse(code, contentType, content);
+  }
+
+  void send(AsyncWebServerResponse *response) {
+    _responseCode = response->nativeCode();
+    _responseBody = response->nativeContent();
+    _responseHeaders = response->nativeHeaders();
+    delete response;
+  }
+
+  // Scratch pointer for handlers, freed when the request ends
+  void *_tempObject = nullptr;
+
+  int nativeResponseCode() const { return _responseCode; }
+  const String &nativeResponseBody() const { return _responseBody; }
+
+  String nativeResponseHeader(const String &name) const {
+    for (auto &header : _responseHeaders) {
+      if (header.name().equalsIgnoreCase(name)) return header.value();
+    }
+    return String();
+  }
+
+private:
+  WebRequestMethodComposite _method = HTTP_GET;
+  size_t _contentLength = 0;
+  String _contentType;
+  int _responseCode = 0;
+  String _responseBody;
+  std::list<AsyncWebHeader> _headers;
+  std::list<AsyncWebHeader> _responseHeaders;
+};
+
+typedef std::function<void(AsyncWebServerRequest *request)> ArRequestHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest *request, const String &filename, size_t index,
+                           uint8_t *data, size_t len, bool final)> ArUploadHandlerFunction;
+typedef std::function<void(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index,
+                           size_t total)> ArBodyHandlerFunction;
+
+class AsyncWebHandler {
+public:
+  virtual ~AsyncWebHandler() {}
+};
+
+class AsyncWebServer {
+public:
+  explicit AsyncWebServer(uint16_t port) { (void)port; }
+
+  void on(const char *uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest,
+          ArUploadHandlerFunction onUpload = nullptr, ArBodyHandlerFunction onBody = nullptr) {
+    (void)onUpload;
+    _routes.push_back({uri, method, onRequest, onBody});
+  }
+
+  // Simulate a request and return it once the matching handler has responded. A body is
+  // delivered to the body handler before the request handler runs, in one chunk as the real
+  // server does for small bodies, or in chunks of chunkSize bytes as it does for larger ones.
+  // As on the real server, form and multipart bodies, and text/plain bodies that look like a
+  // form, are parsed as parameters instead and never reach the body handler.
+  AsyncWebServerRequest nativeRequest(const char *uri, WebRequestMethod method, const char *body = nullptr,
+                                      std::initializer_list<std::pair<const char *, const char *>> headers = {},
+                                      size_t chunkSize = 0) {
+    AsyncWebServerRequest request;
+    request.nativeSetMethod(method);
+    for (auto &header : headers) request.nativeAddHeader(header.first, header.second);
+
+    for (auto &route : _routes) {
+      if (route.uri == uri && (route.method & method)) {
+        if (body && *body) {
+          size_t length = strlen(body);
+          std::string copy(body, length);
+          request.nativeSetContentLength(length);
+          if (!chunkSize) chunkSize = length;
+          bool parameters = nativeParsesAsParameters(request.contentType(), body);
+          for (size_t index = 0; route.onBody && !parameters && index < length; index += chunkSize) {
+            size_t chunk = length - index < chunkSize ? length - index : chunkSize;
+            route.onBody(&request, (uint8_t *)&copy[index], chunk, index, length);
+          }
+        }
+        route.onRequest(&request);
+        free(request._tempObject);
+        request._tempObject = nullptr;
+        return request;
+      }
+    }
+    request.send(404);
+    return request;
+  }
+
+  AsyncWebHandler &addHandler(AsyncWebHandler *handler) { return *handler; }
+
+  // Whether the real server parses a body as form parameters rather than passing it on
+  static bool nativeParsesAsParameters(const String &contentType, const char *body) {
+    if (contentType.startsWith("application/x-www-form-urlencoded") || contentType.startsWith("multipart/")) {
+      return true;
+    }
+    if (contentType != "text/plain") return false;
+    size_t length = strcspn(body, "{[&=");
+    return length > 0 && body[length] == '=' && body[length + 1];
+  }
+  void begin() {}
+
+private:
+  struct Route {
+    std::string uri;
+    WebRequestMethodComposite method;
+    ArRequestHandlerFunction onRequest;
+    ArBodyHandlerFunction onBody;
+  };
+  std::list<Route> _routes;
+};
+
+#pragma region WebSocket
+typedef enum {
+  WS_EVT_CONNECT,
+  WS_EVT_DISCONNECT,
+  WS_EVT_PONG,
+  WS_EVT_ERROR,
+  WS_EVT_DATA
+} AwsEventType;
+
+typedef enum {
+  WS_CONTINUATION,
+  WS_TEXT,
+  WS_BINARY,
+  WS_DISCONNECT = 0x08,
+  WS_PING,
+  WS_PONG
+} AwsFrameType;
+
+typedef struct {
+  uint8_t message_opcode;
+  uint32_t num;
+  uint8_t final;
+  uint8_t masked;
+  uint8_t opcode;
+  uint64_t len;
+  uint8_t mask[4];
+  uint64_t index;
+} AwsFrameInfo;
+
+class AsyncWebSocket;
+
+#ifndef WS_MAX_QUEUED_MESSAGES
+#define WS_MAX_QUEUED_MESSAGES 32
+#endif
+
+typedef enum { WS_MSG_SENDING, WS_MSG_SENT, WS_MSG_ERROR } AwsMessageStatus;
+
+// Reference counted payload shared by the messages queued to several clients
+class AsyncWebSocketMessageBuffer {
+public:
+  explicit AsyncWebSocketMessageBuffer(size_t size) { reserve(size); }
+  ~AsyncWebSocketMessageBuffer() { delete[] _data; }
+  AsyncWebSocketMessageBuffer(const AsyncWebSocketMessageBuffer &) = delete;
+  AsyncWebSocketMessageBuffer &operator=(const AsyncWebSocketMessageBuffer &) = delete;
+
+  void operator++(int) { _count++; }
+  void operator--(int) { if (_count > 0) _count--; }
+  bool reserve(size_t size) {
+    delete[] _data;
+    _len = size;
+    _data = new uint8_t[size + 1]();
+    return true;
+  }
+  void lock() { _lock = true; }
+  void unlock() { _lock = false; }
+  uint8_t *get() { return _data; }
+  size_t length() { return _len; }
+  uint32_t count() { return _count; }
+  bool canDelete() { return !_count && !_lock; }
+
+private:
+  uint8_t *_data = nullptr;
+  size_t _len = 0;
+  bool _lock = false;
+  uint32_t _count = 0;
+};
+
+// Queued outgoing message. The host build sends a message whole, so it is either waiting in
+// its client's queue or sent.
+class AsyncWebSocketMessage {
+protected:
+  uint8_t _opcode = WS_TEXT;
+  bool _mask = false;
+  AwsMessageStatus _status = WS_MSG_ERROR;
+
+public:
+  virtual ~AsyncWebSocketMessage() {}
+  virtual bool finished() { return _status != WS_MSG_SENDING; }
+
+  virtual const uint8_t *nativeData() const { return nullptr; }
+  virtual size_t nativeLength() const { return 0; }
+  void nativeSent() { if (_status == WS_MSG_SENDING) _status = WS_MSG_SENT; }
+};
+
+// Message with its own copy of the payload
+class AsyncWebSocketBasicMessage : public AsyncWebSocketMessage {
+public:
+  AsyncWebSocketBasicMessage(const char *data, size_t len, uint8_t opcode = WS_TEXT, bool mask = false)
+      : _data(data, len) {
+    _opcode = opcode;
+    _mask = mask;
+    _status = WS_MSG_SENDING;
+  }
+
+  const uint8_t *nativeData() const override { return (const uint8_t *)_data.data(); }
+  size_t nativeLength() const override { return _data.size(); }
+
+private:
+  std::string _data;
+};
+
+// Message referring to a shared buffer
+class AsyncWebSocketMultiMessage : public AsyncWebSocketMessage {
+public:
+  AsyncWebSocketMultiMessage(AsyncWebSocketMessageBuffer *buffer, uint8_t opcode = WS_TEXT, bool mask = false)
+      : _buffer(buffer) {
+    _opcode = opcode;
+    _mask = mask;
+    if (_buffer) {
+      (*_buffer)++;
+      _status = WS_MSG_SENDING;
+    }
+  }
+  ~AsyncWebSocketMultiMessage() override {
+    if (_buffer) (*_buffer)--;
+  }
+
+  const uint8_t *nativeData() const override { return _buffer ? _buffer->get() : nullptr; }
+  size_t nativeLength() const override { return _buffer ? _buffer->length() : 0; }
+
+private:
+  AsyncWebSocketMessageBuffer *_buffer;
+};
+
+class AsyncWebSocketClient {
+public:
+  AsyncWebSocketClient(AsyncWebSocket *server, uint32_t id) : _server(server), _id(id) {}
+  ~AsyncWebSocketClient() { nativeDiscard(); }
+  AsyncWebSocketClient(const AsyncWebSocketClient &) = delete;
+  AsyncWebSocketClient &operator=(const AsyncWebSocketClient &) = delete;
+
+  uint32_t id() const { return _id; }
+  IPAddress remoteIP() const { return IPAddress(127, 0, 0, 1); }
+  AsyncWebSocket *server() { return _server; }
+
+  void close(uint16_t code = 0, const char *message = NULL) { (void)code; (void)message; _closing = true; }
+  bool nativeClosing() const { return _closing; }
+
+  // Like the real client, a message that does not fit in the queue is deleted unsent
+  void message(AsyncWebSocketMessage *message) {
+    if (!message) return;
+    if (_queue.size() >= WS_MAX_QUEUED_MESSAGES) delete message;
+    else _queue.push_back(message);
+    nativeRunQueue();
+  }
+  bool queueIsFull() { return _queue.size() >= WS_MAX_QUEUED_MESSAGES; }
+  bool canSend() { return _queue.size() < WS_MAX_QUEUED_MESSAGES; }
+
+  void text(const char *message, size_t len) { this->message(new AsyncWebSocketBasicMessage(message, len)); }
+  void binary(const char *message, size_t len) { this->message(new AsyncWebSocketBasicMessage(message, len, WS_BINARY)); }
+  void text(AsyncWebSocketMessageBuffer *buffer) { message(new AsyncWebSocketMultiMessage(buffer)); }
+  void binary(AsyncWebSocketMessageBuffer *buffer) { message(new AsyncWebSocketMultiMessage(buffer, WS_BINARY)); }
+
+  // Send every queued message, unless the server holds them back
+  void nativeRunQueue();
+
+  // Delete the queued messages unsent, as a disconnect does
+  void nativeDiscard() {
+    for (AsyncWebSocketMessage *message : _queue) delete message;
+    _queue.clear();
+  }
+
+  size_t nativeQueueLength() const { return _queue.size(); }
+
+private:
+  AsyncWebSocket *_server;
+  uint32_t _id;
+  bool _closing = false;
+  std::list<AsyncWebSocketMessage *> _queue;
+};
+
+typedef std::function<void(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type,
+                           void *arg, uint8_t *data, size_t len)> AwsEventHandler;
+
+// Observer for outgoing WebSocket messages: target client (nullptr for a broadcast) and payload
+typedef std::function<void(AsyncWebSocketClient *client, const uint8_t *data, size_t len)> NativeSendHandler;
+
+class AsyncWebSocket : public AsyncWebHandler {
+public:
+  explicit AsyncWebSocket(const String &url) { (void)url; }
+
+  void onEvent(AwsEventHandler handler) { _eventHandler = handler; }
+  size_t count() const { return _clients.size(); }
+  void cleanupClients(uint16_t maxClients = 8) { (void)maxClients; }
+
+  void textAll(const char *message, size_t len) { nativeSend(nullptr, (const uint8_t *)message, len); }
+  void textAll(const String &message) { textAll(message.c_str(), message.length()); }
+
+  void text(uint32_t id, const char *message, size_t len) {
+    AsyncWebSocketClient *c = client(id);
+    if (c) c->text(message, len);
+  }
+  void text(uint32_t id, const String &message) { text(id, message.c_str(), message.length()); }
+  void binary(uint32_t id, const char *message, size_t len) {
+    AsyncWebSocketClient *c = client(id);
+    if (c) c->binary(message, len);
+  }
+  void binary(uint32_t id, uint8_t *message, size_t len) { binary(id, (const char *)message, len); }
+
+  AsyncWebSocketClient *client(uint32_t id) {
+    for (auto &c : _clients) {
+      if (c.id() == id) return &c;
+    }
+    return nullptr;
+  }
+
+  // Simulate a client connecting, optionally asking for a subprotocol, and return it. Like the
+  // real server, the upgrade request is passed as the argument of the connect event. Returns
+  // nullptr if the event handler closed the connection.
+  AsyncWebSocketClient *nativeConnect(const char *protocol = nullptr) {
+    AsyncWebServerRequest request;
+    if (protocol) request.nativeAddHeader("Sec-WebSocket-Protocol", protocol);
+    _clients.emplace_back(this, _nextId++);
+    AsyncWebSocketClient *client = &_clients.back();
+    if (_eventHandler) _eventHandler(this, client, WS_EVT_CONNECT, &request, nullptr, 0);
+    if (client->nativeClosing()) {
+      nativeDisconnect(client);
+      return nullptr;
+    }
+    return client;
+  }
+
+  // Simulate a client disconnecting. Like the real server, its queued messages are deleted
+  // before the disconnect event.
+  void nativeDisconnect(AsyncWebSocketClient *client) {
+    client->nativeDiscard();
+    if (_eventHandler) _eventHandler(this, client, WS_EVT_DISCONNECT, nullptr, nullptr, 0);
+    _clients.remove_if([client](const AsyncWebSocketClient &c) { return &c == client; });
+  }
+
+  // Simulate a complete, unfragmented text frame arriving from a client
+  void nativeReceive(AsyncWebSocketClient *client, const char *message) {
+    size_t len = strlen(message);
+    AwsFrameInfo info = {WS_TEXT, 0, 1, 1, WS_TEXT, len, {0, 0, 0, 0}, 0};
+    std::string payload(message, len);
+    if (_eventHandler) _eventHandler(this, client, WS_EVT_DATA, &info, (uint8_t *)&payload[0], len);
+  }
+
+  // Simulate a complete, unfragmented binary frame arriving from a client
+  void nativeReceiveBinary(AsyncWebSocketClient *client, const uint8_t *data, size_t len) {
+    AwsFrameInfo info = {WS_BINARY, 0, 1, 1, WS_BINARY, len, {0, 0, 0, 0}, 0};
+    std::string payload((const char *)data, len);
+    if (_eventHandler) _eventHandler(this, client, WS_EVT_DATA, &info, (uint8_t *)&payload[0], len);
+  }
+
+  void nativeOnSend(NativeSendHandler handler) { _sendHandler = handler; }
+
+  void nativeSend(AsyncWebSocketClient *client, const uint8_t *data, size_t len) {
+    if (_sendHandler) _sendHandler(client, data, len);
+  }
+
+  // Hold queued messages back, as for clients on a slow link, until nativeFlush()
+  void nativeHold(bool holding) { _holding = holding; }
+  bool nativeHolding() const { return _holding; }
+
+  // Send the messages held back for one client, or for all of them
+  void nativeFlush(AsyncWebSocketClient *only = nullptr) {
+    bool holding = _holding;
+    _holding = false;
+    for (auto &c : _clients) {
+      if (!only || &c == only) c.nativeRunQueue();
+    }
+    _holding = holding;
+  }
+
+private:
+  AwsEventHandler _eventHandler;
+  NativeSendHandler _sendHandler;
+  bool _holding = false;
+  std::list<AsyncWebSocketClient> _clients;
+  uint32_t _nextId = 1;
+};
+
+inline void AsyncWebSocketClient::nativeRunQueue() {
+  if (_server->nativeHolding()) return;
+  while (!_queue.empty()) {
+    AsyncWebSocketMessage *message = _queue.front();
+    _queue.pop_front();
+    _server->nativeSend(this, message->nativeData(), message->nativeLength());
+    message->nativeSent();
+    delete message;
+  }
+}
+#pragma endregion
@@ -0,0 +1,23 @@
+#pragma once
+
+// Host shim for the Arduino-ESP32 EspClass.
+
+#include <stdint.h>
+
+#include "NativeHal.h"
+
+class EspClass {
+public:
+  // The host's time stamp counter where available, otherwise nanoseconds
+  inline uint32_t getCycleCount() {
+#if defined(__x86_64__) || defined(__i386__)
+    return (uint32_t)__builtin_ia32_rdtsc();
+#else
+    return (uint32_t)(nativeNowMicros() * 1000);
+#endif
+  }
+
+  uint32_t getFreeHeap() { return 0; }
+};
+
+extern EspClass ESP;
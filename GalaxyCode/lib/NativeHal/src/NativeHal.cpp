@@ -0,0 +1,462 @@
+#include "NativeHal.h"
+
+#include <Arduino.h>
+#include <AsyncElegantOTA.h>
+#include <WiFi.h>
+#include <driver/ledc.h>
+#include <esp_timer.h>
+#include <freertos/queue.h>
+#include <soc/gpio_reg.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+HardwareSerial Serial;
+EspClass ESP;
+WiFiClass WiFi;
+AsyncElegantOtaClass AsyncElegantOTA;
+
+#pragma region Clock
+static uint64_t monotonicMicros() {
+  using namespace std::chrono;
+  static const steady_clock::time_point start = steady_clock::now();
+  return duration_cast<microseconds>(steady_clock::now() - start).count();
+}
+
+static std::atomic<uint64_t> virtualMicros(0);
+static uint64_t readVirtualClock() { return virtualMicros.load(); }
+
+static std::atomic<NativeClockSource> clockSource(monotonicMicros);
+
+// Delays sleep on this condition variable so that advancing the virtual clock wakes them
+static std::mutex clockMutex;
+static std::condition_variable clockAdvanced;
+
+void nativeSetClock(NativeClockSource source) {
+  clockSource.store(source ? source : monotonicMicros);
+  clockAdvanced.notify_all();
+}
+
+void nativeUseVirtualClock(uint64_t startMicros) {
+  virtualMicros.store(startMicros);
+  nativeSetClock(readVirtualClock);
+}
+
+void nativeAdvanceClock(uint64_t deltaMicros) {
+  {
+    std::lock_guard<std::mutex> lock(clockMutex);
+    virtualMicros.fetch_add(deltaMicros);
+  }
+  clockAdvanced.notify_all();
+}
+
+uint64_t nativeNowMicros() {
+  return clockSource.load()();
+}
+
+/**
+ * Block the calling thread until the active clock reaches the given deadline.
+ *
+ * With the host clock this is a plain sleep. With any other source the thread waits to be
+ * woken by nativeAdvanceClock(), re-checking periodically in case a custom source moves on
+ * its own.
+ */
+static void sleepUntilMicros(uint64_t deadline) {
+  for (;;) {
+    uint64_t now = nativeNowMicros();
+    if (now >= deadline) return;
+
+    if (clockSource.load() == monotonicMicros) {
+      std::this_thread::sleep_for(std::chrono::microseconds(deadline - now));
+    } else {
+      std::unique_lock<std::mutex> lock(clockMutex);
+      clockAdvanced.wait_for(lock, std::chrono::milliseconds(1));
+    }
+  }
+}
+
+uint32_t esp_random() {
+  static std::mt19937 generator(std::random_device{}());
+  return generator();
+}
+
+unsigned long millis() { return (unsigned long)(nativeNowMicros() / 1000); }
+unsigned long micros() { return (unsigned long)nativeNowMicros(); }
+void delay(uint32_t ms) { sleepUntilMicros(nativeNowMicros() + (uint64_t)ms * 1000); }
+void delayMicroseconds(uint32_t us) { sleepUntilMicros(nativeNowMicros() + us); }
+#pragma endregion
+
+#pragma region Pins
+static std::atomic<int> pinValues[NATIVE_PIN_COUNT];
+static std::atomic<int> pinLevels[NATIVE_PIN_COUNT];
+
+struct NativeInterrupt {
+  void (*handler)(void *);
+  void *arg;
+  int mode;
+};
+
+static NativeInterrupt pinInterrupts[NATIVE_PIN_COUNT];
+static std::mutex interruptMutex;
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  // Inputs with a pull-up idle high until a level is injected
+  if (pin < NATIVE_PIN_COUNT && mode == INPUT_PULLUP) pinLevels[pin].store(HIGH);
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+  if (pin < NATIVE_PIN_COUNT) pinValues[pin].store(val);
+}
+
+int digitalRead(uint8_t pin) {
+  return pin < NATIVE_PIN_COUNT ? pinLevels[pin].load() : LOW;
+}
+
+void analogWrite(uint8_t pin, int value) {
+  // Matches the Arduino-ESP32 core, which clamps to the 8-bit range
+  if (pin < NATIVE_PIN_COUNT) pinValues[pin].store(value < 0 ? 0 : value > 255 ? 255 : value);
+}
+
+void attachInterruptArg(uint8_t pin, void (*userFunc)(void *), void *arg, int mode) {
+  std::lock_guard<std::mutex> lock(interruptMutex);
+  if (pin < NATIVE_PIN_COUNT) pinInterrupts[pin] = {userFunc, arg, mode};
+}
+
+void detachInterrupt(uint8_t pin) {
+  std::lock_guard<std::mutex> lock(interruptMutex);
+  if (pin < NATIVE_PIN_COUNT) pinInterrupts[pin] = {nullptr, nullptr, 0};
+}
+
+void nativeSetPinLevel(uint8_t pin, int level) {
+  if (pin >= NATIVE_PIN_COUNT) return;
+  int previous = pinLevels[pin].exchange(level);
+  if (previous == level) return;
+
+  // Interrupts are serialised, as a single GPIO interrupt handler would be
+  std::lock_guard<std::mutex> lock(interruptMutex);
+  NativeInterrupt &interrupt = pinInterrupts[pin];
+  int edge = level == HIGH ? RISING : FALLING;
+  if (interrupt.handler && (interrupt.mode & edge)) interrupt.handler(interrupt.arg);
+}
+
+uint32_t nativeReadRegister(uint32_t address) {
+  // The input registers hold one bit per GPIO: 0-31 in GPIO_IN_REG and 32-39 in GPIO_IN1_REG
+  uint8_t first = address == GPIO_IN_REG ? 0 : address == GPIO_IN1_REG ? 32 : NATIVE_PIN_COUNT;
+  uint32_t value = 0;
+  for (uint8_t pin = first; pin < NATIVE_PIN_COUNT && pin < first + 32; pin++) {
+    if (pinLevels[pin].load()) value |= 1UL << (pin - first);
+  }
+  return value;
+}
+
+int nativeGetPinValue(uint8_t pin) {
+  return pin < NATIVE_PIN_COUNT ? pinValues[pin].load() : 0;
+}
+#pragma endregion
+
+#pragma region LEDC
+struct NativeLedcChannel {
+  int gpio = -1;
+  uint32_t stagedDuty = 0;
+  uint32_t activeDuty = 0;
+};
+
+static NativeLedcChannel ledcChannels[LEDC_SPEED_MODE_MAX][LEDC_CHANNEL_MAX];
+
+static bool ledcValid(ledc_mode_t mode, ledc_channel_t channel) {
+  return mode < LEDC_SPEED_MODE_MAX && channel < LEDC_CHANNEL_MAX;
+}
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t *timer_conf) {
+  if (!timer_conf || timer_conf->duty_resolution >= LEDC_TIMER_BIT_MAX || !timer_conf->freq_hz) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  return ESP_OK;
+}
+
+esp_err_t ledc_channel_config(const ledc_channel_config_t *ledc_conf) {
+  if (!ledc_conf || !ledcValid(ledc_conf->speed_mode, ledc_conf->channel)) return ESP_ERR_INVALID_ARG;
+
+  NativeLedcChannel &channel = ledcChannels[ledc_conf->speed_mode][ledc_conf->channel];
+  channel.gpio = ledc_conf->gpio_num;
+  channel.stagedDuty = channel.activeDuty = ledc_conf->duty;
+  if (channel.gpio >= 0 && channel.gpio < NATIVE_PIN_COUNT) pinValues[channel.gpio].store(ledc_conf->duty);
+  return ESP_OK;
+}
+
+esp_err_t ledc_set_duty(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t duty) {
+  if (!ledcValid(speed_mode, channel)) return ESP_ERR_INVALID_ARG;
+  ledcChannels[speed_mode][channel].stagedDuty = duty;
+  return ESP_OK;
+}
+
+esp_err_t ledc_update_duty(ledc_mode_t speed_mode, ledc_channel_t channel) {
+  if (!ledcValid(speed_mode, channel)) return ESP_ERR_INVALID_ARG;
+
+  NativeLedcChannel &ch = ledcChannels[speed_mode][channel];
+  ch.activeDuty = ch.stagedDuty;
+  if (ch.gpio >= 0 && ch.gpio < NATIVE_PIN_COUNT) pinValues[ch.gpio].store(ch.activeDuty);
+  return ESP_OK;
+}
+
+uint32_t ledc_get_duty(ledc_mode_t speed_mode, ledc_channel_t channel) {
+  return ledcValid(speed_mode, channel) ? ledcChannels[speed_mode][channel].activeDuty : 0;
+}
+#pragma endregion
+
+#pragma region Tasks
+struct NativeTask {
+  TaskFunction_t function;
+  void *parameters;
+  BaseType_t coreID;
+
+  // Direct-to-task notification count
+  std::mutex notifyMutex;
+  std::condition_variable notified;
+  uint32_t notifyValue = 0;
+};
+
+static thread_local NativeTask *currentTask = nullptr;
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pvTaskCode, const char *pcName, uint32_t usStackDepth,
+                                   void *pvParameters, UBaseType_t uxPriority, TaskHandle_t *pvCreatedTask,
+                                   BaseType_t xCoreID) {
+  (void)pcName; (void)usStackDepth; (void)uxPriority;
+
+  // Task objects live for the lifetime of the process, as tasks in the firmware never exit
+  NativeTask *task = new NativeTask();
+  task->function = pvTaskCode;
+  task->parameters = pvParameters;
+  task->coreID = xCoreID == tskNO_AFFINITY ? 0 : xCoreID;
+  if (pvCreatedTask) *pvCreatedTask = task;
+
+  std::thread([task]() {
+    currentTask = task;
+    task->function(task->parameters);
+  }).detach();
+  return pdPASS;
+}
+
+void vTaskDelay(TickType_t xTicksToDelay) {
+  if (xTicksToDelay == 0) {
+    std::this_thread::yield();
+    return;
+  }
+  delay(xTicksToDelay * portTICK_PERIOD_MS);
+}
+
+void vTaskDelayUntil(TickType_t *pxPreviousWakeTime, TickType_t xTimeIncrement) {
+  // As in FreeRTOS, a deadline that has already passed returns immediately
+  TickType_t wakeTime = *pxPreviousWakeTime + xTimeIncrement;
+  *pxPreviousWakeTime = wakeTime;
+  sleepUntilMicros((uint64_t)wakeTime * portTICK_PERIOD_MS * 1000);
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify) {
+  {
+    std::lock_guard<std::mutex> lock(xTaskToNotify->notifyMutex);
+    xTaskToNotify->notifyValue++;
+  }
+  xTaskToNotify->notified.notify_one();
+  return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait) {
+  NativeTask *task = currentTask;
+  if (!task) return 0;
+
+  // Timeouts follow the active clock; waits are sliced so a virtual clock is noticed advancing
+  uint64_t deadline = nativeNowMicros() + (uint64_t)xTicksToWait * portTICK_PERIOD_MS * 1000;
+  std::unique_lock<std::mutex> lock(task->notifyMutex);
+  while (task->notifyValue == 0) {
+    if (xTicksToWait != portMAX_DELAY && nativeNowMicros() >= deadline) return 0;
+    task->notified.wait_for(lock, std::chrono::milliseconds(1));
+  }
+
+  uint32_t value = task->notifyValue;
+  task->notifyValue = xClearCountOnExit ? 0 : value - 1;
+  return value;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+  return currentTask;
+}
+
+TickType_t xTaskGetTickCount() {
+  return (TickType_t)(nativeNowMicros() / (1000 * portTICK_PERIOD_MS));
+}
+
+BaseType_t xPortGetCoreID() {
+  // The Arduino loop task runs on core 1
+  return currentTask ? currentTask->coreID : 1;
+}
+#pragma endregion
+
+#pragma region Queues
+struct NativeQueue {
+  size_t length;
+  size_t itemSize;
+  std::deque<std::vector<uint8_t>> items;
+  std::mutex mutex;
+  std::condition_variable changed;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize) {
+  NativeQueue *queue = new NativeQueue();
+  queue->length = uxQueueLength;
+  queue->itemSize = uxItemSize;
+  return queue;
+}
+
+/**
+ * Wait on a queue until a condition holds or the timeout (in ticks on the active clock) expires.
+ */
+template <typename Predicate>
+static bool queueWait(NativeQueue *queue, std::unique_lock<std::mutex> &lock, TickType_t ticks, Predicate ready) {
+  uint64_t deadline = nativeNowMicros() + (uint64_t)ticks * portTICK_PERIOD_MS * 1000;
+  while (!ready()) {
+    if (ticks != portMAX_DELAY && nativeNowMicros() >= deadline) return false;
+    queue->changed.wait_for(lock, std::chrono::milliseconds(1));
+  }
+  return true;
+}
+
+BaseType_t xQueueSend(QueueHandle_t xQueue, const void *pvItemToQueue, TickType_t xTicksToWait) {
+  std::unique_lock<std::mutex> lock(xQueue->mutex);
+  if (!queueWait(xQueue, lock, xTicksToWait, [xQueue]() { return xQueue->items.size() < xQueue->length; })) {
+    return pdFAIL;
+  }
+
+  const uint8_t *item = static_cast<const uint8_t *>(pvItemToQueue);
+  xQueue->items.emplace_back(item, item + xQueue->itemSize);
+  xQueue->changed.notify_all();
+  return pdPASS;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t xQueue, const void *pvItemToQueue, BaseType_t *pxHigherPriorityTaskWoken) {
+  if (pxHigherPriorityTaskWoken) *pxHigherPriorityTaskWoken = pdFALSE;
+  return xQueueSend(xQueue, pvItemToQueue, 0);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void *pvBuffer, TickType_t xTicksToWait) {
+  std::unique_lock<std::mutex> lock(xQueue->mutex);
+  if (!queueWait(xQueue, lock, xTicksToWait, [xQueue]() { return !xQueue->items.empty(); })) return pdFAIL;
+
+  memcpy(pvBuffer, xQueue->items.front().data(), xQueue->itemSize);
+  xQueue->items.pop_front();
+  xQueue->changed.notify_all();
+  return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t xQueue) {
+  std::lock_guard<std::mutex> lock(xQueue->mutex);
+  return xQueue->items.size();
+}
+#pragma endregion
+
+#pragma region Timers
+struct NativeTimer {
+  esp_timer_cb_t callback;
+  void *arg;
+  uint64_t deadline; // Expiry time in microseconds, 0 while stopped
+};
+
+// Never destroyed, as the detached service thread may still be using them when the program
+// exits
+static std::vector<NativeTimer *> &timers = *new std::vector<NativeTimer *>();
+static std::mutex &timerMutex = *new std::mutex();
+static std::condition_variable &timersChanged = *new std::condition_variable();
+
+/**
+ * Timer service thread: fire each timer once its deadline passes, one callback at a time.
+ */
+static void timerService() {
+  std::unique_lock<std::mutex> lock(timerMutex);
+  for (;;) {
+    NativeTimer *next = nullptr;
+    for (NativeTimer *timer : timers) {
+      if (timer->deadline && (!next || timer->deadline < next->deadline)) next = timer;
+    }
+
+    if (next && nativeNowMicros() >= next->deadline) {
+      next->deadline = 0;
+      lock.unlock();
+      next->callback(next->arg);
+      lock.lock();
+      continue;
+    }
+
+    // Sliced waits notice a virtual clock advancing
+    timersChanged.wait_for(lock, std::chrono::milliseconds(1));
+  }
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle) {
+  if (!create_args || !create_args->callback || !out_handle) return ESP_ERR_INVALID_ARG;
+
+  static std::once_flag serviceStarted;
+  std::call_once(serviceStarted, []() { std::thread(timerService).detach(); });
+
+  std::lock_guard<std::mutex> lock(timerMutex);
+  NativeTimer *timer = new NativeTimer{create_args->callback, create_args->arg, 0};
+  timers.push_back(timer);
+  *out_handle = timer;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+  std::lock_guard<std::mutex> lock(timerMutex);
+  if (timer->deadline) return ESP_ERR_INVALID_STATE;
+  timer->deadline = nativeNowMicros() + timeout_us;
+  if (!timer->deadline) timer->deadline = 1;
+  timersChanged.notify_all();
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+  std::lock_guard<std::mutex> lock(timerMutex);
+  if (!timer->deadline) return ESP_ERR_INVALID_STATE;
+  timer->deadline = 0;
+  return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer) {
+  std::lock_guard<std::mutex> lock(timerMutex);
+  return timer->deadline != 0;
+}
+
+int64_t esp_timer_get_time() {
+  return (int64_t)nativeNowMicros();
+}
+#pragma endregion
+
+/**
+ * Host entry point mirroring the Arduino-ESP32 loop task: run setup() once, then loop().
+ *
+ * The ESP32 loop task calls loop() back to back; here it is paced at 1 kHz so that the host
+ * process does not burn a core on an empty loop and CPU profiles reflect the firmware tasks.
+ * Setting GALAXY_RUN_MS in the environment exits after that many milliseconds, which is
+ * convenient for timed profiling runs.
+ *
+ * Declared weak so a benchmark harness can provide its own main().
+ */
+__attribute__((weak)) int main() {
+  const char *runMs = getenv("GALAXY_RUN_MS");
+  uint64_t deadline = runMs ? nativeNowMicros() + strtoull(runMs, nullptr, 10) * 1000 : 0;
+
+  setup();
+  for (;;) {
+    loop();
+    delay(1);
+    if (deadline && nativeNowMicros() >= deadline) {
+      fflush(stdout);
+      _Exit(0);
+    }
+  }
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Host-side hooks for driving the firmware off-device.
+ *
+ * The shimmed Arduino and FreeRTOS calls (millis, micros, delay, vTaskDelay, ...) all read
+ * time through a single clock source. By default this is the host's monotonic clock. A
+ * benchmark or profiling harness can replace it with the built-in virtual clock, which only
+ * moves when nativeAdvanceClock() is called, or with its own source.
+ *
+ * Pins are modelled as an array of levels: outputs record the last value written by
+ * digitalWrite/analogWrite and inputs return whatever was injected with nativeSetPinLevel().
+ * Injecting a level runs the pin's interrupt handler, if one is attached and the edge matches.
+ */
+
+// Number of GPIOs modelled by the host shim (matches the ESP32's 40 GPIOs)
+#define NATIVE_PIN_COUNT 40
+
+// Clock source returning the current time in microseconds
+typedef uint64_t (*NativeClockSource)();
+
+/**
+ * Replace the clock source used by millis(), micros() and the delay functions.
+ *
+ * @param source The new clock source, or nullptr to restore the host's monotonic clock.
+ */
+void nativeSetClock(NativeClockSource source);
+
+/**
+ * Switch to the built-in virtual clock, starting at the given time.
+ *
+ * While the virtual clock is active, delays block until another thread advances the clock
+ * past their deadline with nativeAdvanceClock().
+ *
+ * @param startMicros The initial value of the virtual clock in microseconds.
+ */
+void nativeUseVirtualClock(uint64_t startMicros = 0);
+
+/**
+ * Advance the virtual clock and wake any task whose delay has expired.
+ *
+ * @param deltaMicros The number of microseconds to advance the clock by.
+ */
+void nativeAdvanceClock(uint64_t deltaMicros);
+
+/**
+ * Read the current time from the active clock source in microseconds.
+ */
+uint64_t nativeNowMicros();
+
+/**
+ * Set the level read back by digitalRead() for a pin, e.g. to simulate a switch press.
+ *
+ * If the level changes and an interrupt handler is attached for that edge, the handler is
+ * called on the calling thread before this returns.
+ *
+ * @param pin The GPIO number.
+ * @param level The level to report (LOW or HIGH).
+ */
+void nativeSetPinLevel(uint8_t pin, int level);
+
+/**
+ * Get the last value written to a pin by digitalWrite() or analogWrite().
+ *
+ * @param pin The GPIO number.
+ * @return The last written value, or 0 if the pin has never been written.
+ */
+int nativeGetPinValue(uint8_t pin);
@@ -0,0 +1,38 @@
+#pragma once
+
+// Host shim for the ESP32 WiFi library. The host is always "connected" so that the web
+// server and WebSocket code paths are initialised as they would be on the device.
+
+#include <Arduino.h>
+
+typedef enum {
+  WIFI_OFF,
+  WIFI_STA,
+  WIFI_AP,
+  WIFI_AP_STA
+} wifi_mode_t;
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_DISCONNECTED = 6
+} wl_status_t;
+
+class WiFiClass {
+public:
+  bool mode(wifi_mode_t mode) { (void)mode; return true; }
+  wl_status_t begin(const char *ssid, const char *passphrase) { (void)ssid; (void)passphrase; _status = WL_CONNECTED; return _status; }
+  bool setHostname(const char *hostname) { (void)hostname; return true; }
+  bool config(IPAddress localIP, IPAddress gateway, IPAddress subnet) { _localIP = localIP; (void)gateway; (void)subnet; return true; }
+  bool disconnect() { _status = WL_DISCONNECTED; return true; }
+  wl_status_t status() { return _status; }
+  IPAddress localIP() { return _localIP; }
+
+private:
+  wl_status_t _status = WL_DISCONNECTED;
+  IPAddress _localIP;
+};
+
+extern WiFiClass WiFi;
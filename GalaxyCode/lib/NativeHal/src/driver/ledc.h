@@ -0,0 +1,86 @@
+#pragma once
+
+// Host shim for the ESP-IDF LEDC driver.
+//
+// Each channel keeps a staged duty (ledc_set_duty) and an active duty (ledc_update_duty),
+// mirroring the hardware's shadow registers. The active duty is also reported as the value
+// of the bound GPIO through nativeGetPinValue().
+
+#include <esp_err.h>
+
+typedef enum {
+  LEDC_HIGH_SPEED_MODE = 0,
+  LEDC_LOW_SPEED_MODE,
+  LEDC_SPEED_MODE_MAX
+} ledc_mode_t;
+
+typedef enum {
+  LEDC_CHANNEL_0 = 0,
+  LEDC_CHANNEL_1,
+  LEDC_CHANNEL_2,
+  LEDC_CHANNEL_3,
+  LEDC_CHANNEL_4,
+  LEDC_CHANNEL_5,
+  LEDC_CHANNEL_6,
+  LEDC_CHANNEL_7,
+  LEDC_CHANNEL_MAX
+} ledc_channel_t;
+
+typedef enum {
+  LEDC_TIMER_0 = 0,
+  LEDC_TIMER_1,
+  LEDC_TIMER_2,
+  LEDC_TIMER_3,
+  LEDC_TIMER_MAX
+} ledc_timer_t;
+
+typedef enum {
+  LEDC_TIMER_1_BIT = 1,
+  LEDC_TIMER_8_BIT = 8,
+  LEDC_TIMER_10_BIT = 10,
+  LEDC_TIMER_12_BIT = 12,
+  LEDC_TIMER_14_BIT = 14,
+  LEDC_TIMER_16_BIT = 16,
+  LEDC_TIMER_20_BIT = 20,
+  LEDC_TIMER_BIT_MAX
+} ledc_timer_bit_t;
+
+typedef enum {
+  LEDC_AUTO_CLK = 0,
+  LEDC_USE_REF_TICK,
+  LEDC_USE_APB_CLK,
+  LEDC_USE_RTC8M_CLK
+} ledc_clk_cfg_t;
+
+typedef enum {
+  LEDC_INTR_DISABLE = 0,
+  LEDC_INTR_FADE_END,
+  LEDC_INTR_MAX
+} ledc_intr_type_t;
+
+typedef struct {
+  ledc_mode_t speed_mode;
+  ledc_timer_bit_t duty_resolution;
+  ledc_timer_t timer_num;
+  uint32_t freq_hz;
+  ledc_clk_cfg_t clk_cfg;
+} ledc_timer_config_t;
+
+typedef struct {
+  int gpio_num;
+  ledc_mode_t speed_mode;
+  ledc_channel_t channel;
+  ledc_intr_type_t intr_type;
+  ledc_timer_t timer_sel;
+  uint32_t duty;
+  int hpoint;
+  struct {
+    unsigned int output_invert : 1;
+  } flags;
+} ledc_channel_config_t;
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t *timer_conf);
+esp_err_t ledc_channel_config(const ledc_channel_config_t *ledc_conf);
+esp_err_t ledc_set_duty(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t duty);
+esp_err_t ledc_update_duty(ledc_mode_t speed_mode, ledc_channel_t channel);
+uint32_t ledc_get_duty(ledc_mode_t speed_mode, ledc_channel_t channel);
@@ -0,0 +1,53 @@
+#pragma once
+
+// Host shim for the FreeRTOS types and constants used by the firmware.
+
+#include <stdint.h>
+
+#include <atomic>
+#include <thread>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE ((BaseType_t)1)
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+
+// The ESP32 Arduino core runs FreeRTOS with a 1 kHz tick
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS ((TickType_t)1000 / configTICK_RATE_HZ)
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define pdMS_TO_TICKS(xTimeInMs) ((TickType_t)(((TickType_t)(xTimeInMs) * (TickType_t)configTICK_RATE_HZ) / (TickType_t)1000U))
+
+#define tskNO_AFFINITY 0x7FFFFFFF
+
+// Critical sections are modelled as spinlocks, as on the dual-core ESP32. Nesting the same
+// lock is not supported.
+typedef struct {
+  std::atomic_flag locked;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {ATOMIC_FLAG_INIT}
+
+static inline void vPortEnterCritical(portMUX_TYPE *mux) {
+  // Yield while spinning, as the holder may be preempted on a host with fewer cores
+  while (mux->locked.test_and_set(std::memory_order_acquire)) {
+    std::this_thread::yield();
+  }
+}
+
+static inline void vPortExitCritical(portMUX_TYPE *mux) {
+  mux->locked.clear(std::memory_order_release);
+}
+
+#define portENTER_CRITICAL(mux) vPortEnterCritical(mux)
+#define portEXIT_CRITICAL(mux) vPortExitCritical(mux)
+#define portENTER_CRITICAL_ISR(mux) vPortEnterCritical(mux)
+#define portEXIT_CRITICAL_ISR(mux) vPortExitCritical(mux)
+
+// Interrupts are simulated by calling the handler on the thread that changes the pin, so there
+// is no scheduler to hand over to on exit
+#define portYIELD_FROM_ISR(...) ((void)0)
@@ -0,0 +1,16 @@
+#pragma once
+
+// Host shim for the FreeRTOS queue API: fixed-size items copied in and out of a bounded FIFO.
+
+#include "FreeRTOS.h"
+
+struct NativeQueue;
+typedef NativeQueue *QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize);
+
+BaseType_t xQueueSend(QueueHandle_t xQueue, const void *pvItemToQueue, TickType_t xTicksToWait);
+BaseType_t xQueueSendFromISR(QueueHandle_t xQueue, const void *pvItemToQueue, BaseType_t *pxHigherPriorityTaskWoken);
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void *pvBuffer, TickType_t xTicksToWait);
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t xQueue);
@@ -0,0 +1,25 @@
+#pragma once
+
+// Host shim for the FreeRTOS task API. Tasks are backed by detached std::threads.
+
+#include "FreeRTOS.h"
+
+struct NativeTask;
+typedef NativeTask *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pvTaskCode, const char *pcName, uint32_t usStackDepth,
+                                   void *pvParameters, UBaseType_t uxPriority, TaskHandle_t *pvCreatedTask,
+                                   BaseType_t xCoreID);
+
+#define taskYIELD() std::this_thread::yield()
+
+void vTaskDelay(TickType_t xTicksToDelay);
+void vTaskDelayUntil(TickType_t *pxPreviousWakeTime, TickType_t xTimeIncrement);
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify);
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait);
+
+TaskHandle_t xTaskGetCurrentTaskHandle();
+TickType_t xTaskGetTickCount();
+BaseType_t xPortGetCoreID();
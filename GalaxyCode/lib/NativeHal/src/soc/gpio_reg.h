@@ -0,0 +1,9 @@
+#pragma once
+
+// Host shim for the ESP32 GPIO registers, backed by the modelled pin levels.
+
+#include "soc.h"
+
+#define DR_REG_GPIO_BASE 0x3ff44000
+#define GPIO_IN_REG (DR_REG_GPIO_BASE + 0x003c)  // Input levels of GPIO0-31
+#define GPIO_IN1_REG (DR_REG_GPIO_BASE + 0x0040) // Input levels of GPIO32-39 in bits 0-7
@@ -0,0 +1,9 @@
+#pragma once
+
+// Host shim for ESP32 register access. Only the registers modelled by NativeHal can be read.
+
+#include <stdint.h>
+
+uint32_t nativeReadRegister(uint32_t address);
+
+#define REG_READ(_r) nativeReadRegister(_r)
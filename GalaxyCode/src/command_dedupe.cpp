@@ -0,0 +1,83 @@
+#include "command_dedupe.h"
+
+struct DedupeEntry {
+  uint32_t clientId; // 0 for a free entry
+  uint16_t highest;  // Highest sequence number seen
+  uint32_t seen;     // Bit n set if sequence number highest - n has been seen
+  uint32_t lastUsed; // Use counter value of the last check, for eviction
+};
+
+static DedupeEntry entries[DEDUPE_CLIENTS] = {};
+static uint32_t useCounter = 0;
+
+// Checks come from the network task, but guard the table in case of several
+static portMUX_TYPE dedupeLock = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * Find a client's entry. The caller must hold dedupeLock.
+ */
+static DedupeEntry *findEntry(uint32_t clientId) {
+  for (DedupeEntry &entry : entries) {
+    if (entry.clientId == clientId) return &entry;
+  }
+  return nullptr;
+}
+
+/**
+ * Take a free entry, or the least recently used one. The caller must hold dedupeLock.
+ */
+static DedupeEntry *claimEntry(uint32_t clientId) {
+  DedupeEntry *oldest = &entries[0];
+  for (DedupeEntry &entry : entries) {
+    if (!entry.clientId) {
+      oldest = &entry;
+      break;
+    }
+    if ((int32_t)(entry.lastUsed - oldest->lastUsed) < 0) oldest = &entry;
+  }
+  oldest->clientId = clientId;
+  return oldest;
+}
+
+DedupeResultEnum dedupeCheck(uint32_t clientId, uint16_t sequence) {
+  portENTER_CRITICAL(&dedupeLock);
+
+  DedupeResultEnum result = DedupeNew;
+  DedupeEntry *entry = findEntry(clientId);
+
+  if (!entry) {
+    // First command from this client
+    entry = claimEntry(clientId);
+    entry->highest = sequence;
+    entry->seen = 1;
+  } else {
+    // Sequence numbers wrap, so compare the signed distance to the highest
+    int16_t ahead = (int16_t)(sequence - entry->highest);
+    if (ahead > 0) {
+      entry->seen = ahead < DEDUPE_WINDOW ? (entry->seen << ahead) | 1 : 1;
+      entry->highest = sequence;
+    } else if (-ahead >= DEDUPE_WINDOW) {
+      result = DedupeStale;
+    } else if (entry->seen & (1UL << -ahead)) {
+      result = DedupeDuplicate;
+    } else {
+      entry->seen |= 1UL << -ahead;
+    }
+  }
+  entry->lastUsed = ++useCounter;
+
+  portEXIT_CRITICAL(&dedupeLock);
+  return result;
+}
+
+void dedupeForget(uint32_t clientId, uint16_t sequence) {
+  portENTER_CRITICAL(&dedupeLock);
+
+  DedupeEntry *entry = findEntry(clientId);
+  if (entry) {
+    int16_t behind = (int16_t)(entry->highest - sequence);
+    if (behind >= 0 && behind < DEDUPE_WINDOW) entry->seen &= ~(1UL << behind);
+  }
+
+  portEXIT_CRITICAL(&dedupeLock);
+}
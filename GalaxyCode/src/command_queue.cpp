@@ -0,0 +1,145 @@
+#include "command_queue.h"
+
+#include <atomic>
+
+const char *const COMMAND_SOURCE_NAMES[CommandSourceLast] = {"Switch", "WebSocket", "REST"};
+
+CommandStats commandStats[CommandSourceLast] = {};
+
+// One slot of a ring. The sequence tells producers and the consumer whose turn the slot is:
+// it equals the enqueue position when the slot is free, and the position + 1 once written.
+struct CommandCell {
+  std::atomic<uint32_t> sequence;
+  Command command;
+};
+
+struct CommandRing {
+  CommandCell cells[COMMAND_QUEUE_SIZE];
+  std::atomic<uint32_t> enqueuePosition; // Claimed by producers with a compare-and-swap
+  uint32_t dequeuePosition;              // Only touched by the single consumer
+};
+
+// One ring per source, indexed by CommandSourceEnum
+static CommandRing rings[CommandSourceLast];
+
+static TaskHandle_t volatile ownerTask = nullptr;
+
+// Patches waiting for the state owner. A slot is claimed by a producer and freed by the owner.
+struct PatchSlot {
+  std::atomic<bool> busy;
+  StatePatch patch;
+};
+static PatchSlot patchSlots[STATE_PATCH_SLOTS];
+
+void commandQueueBegin() {
+  for (CommandRing &ring : rings) {
+    for (uint32_t i = 0; i < COMMAND_QUEUE_SIZE; i++) {
+      ring.cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    ring.enqueuePosition.store(0, std::memory_order_relaxed);
+    ring.dequeuePosition = 0;
+  }
+  for (PatchSlot &patchSlot : patchSlots) {
+    patchSlot.busy.store(false, std::memory_order_relaxed);
+  }
+}
+
+void commandQueueSetOwner(TaskHandle_t owner) {
+  ownerTask = owner;
+}
+
+/**
+ * Append a command to a ring, or fail if it is full.
+ */
+static bool ringPush(CommandRing &ring, const Command &command) {
+  uint32_t position = ring.enqueuePosition.load(std::memory_order_relaxed);
+  CommandCell *cell;
+
+  for (;;) {
+    cell = &ring.cells[position & (COMMAND_QUEUE_SIZE - 1)];
+    uint32_t sequence = cell->sequence.load(std::memory_order_acquire);
+    int32_t difference = (int32_t)(sequence - position);
+
+    if (difference == 0) {
+      // The slot is free: claim it, or retry from wherever another producer left the position
+      if (ring.enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+    } else if (difference < 0) {
+      // The slot still holds a command from the previous lap, so the ring is full
+      return false;
+    } else {
+      position = ring.enqueuePosition.load(std::memory_order_relaxed);
+    }
+  }
+
+  cell->command = command;
+  cell->sequence.store(position + 1, std::memory_order_release);
+  return true;
+}
+
+/**
+ * Take the oldest command from a ring, or fail if it is empty.
+ */
+static bool ringPop(CommandRing &ring, Command &command) {
+  uint32_t position = ring.dequeuePosition;
+  CommandCell &cell = ring.cells[position & (COMMAND_QUEUE_SIZE - 1)];
+
+  if ((int32_t)(cell.sequence.load(std::memory_order_acquire) - (position + 1)) < 0) return false;
+
+  command = cell.command;
+  cell.sequence.store(position + COMMAND_QUEUE_SIZE, std::memory_order_release);
+  ring.dequeuePosition = position + 1;
+  return true;
+}
+
+bool commandSubmit(CommandTypeEnum type, CommandSourceEnum source, uint32_t value, uint32_t replyTo, uint16_t sequence) {
+  Command command = {type, source, value, (uint32_t)micros(), replyTo, sequence};
+
+  if (!ringPush(rings[source], command)) {
+    commandStats[source].dropped++;
+    return false;
+  }
+
+  commandStats[source].submitted++;
+  TaskHandle_t owner = ownerTask;
+  if (owner) xTaskNotifyGive(owner);
+  return true;
+}
+
+bool commandSubmitPatch(const StatePatch &patch, CommandSourceEnum source) {
+  for (uint32_t slot = 0; slot < STATE_PATCH_SLOTS; slot++) {
+    PatchSlot &patchSlot = patchSlots[slot];
+    if (patchSlot.busy.load(std::memory_order_relaxed) || patchSlot.busy.exchange(true, std::memory_order_acquire)) continue;
+
+    patchSlot.patch = patch;
+    if (commandSubmit(PatchStateCommand, source, slot)) return true;
+
+    // The queue is full, so nothing will take the patch
+    patchSlot.busy.store(false, std::memory_order_release);
+    return false;
+  }
+
+  commandStats[source].dropped++;
+  return false;
+}
+
+void commandTakePatch(const Command &command, StatePatch &patch) {
+  PatchSlot &patchSlot = patchSlots[command.value];
+  patch = patchSlot.patch;
+  patchSlot.busy.store(false, std::memory_order_release);
+}
+
+bool commandReceive(Command &command) {
+  for (CommandRing &ring : rings) {
+    if (ringPop(ring, command)) return true;
+  }
+  return false;
+}
+
+void commandComplete(const Command &command) {
+  uint32_t latency = (uint32_t)micros() - command.enqueuedAt;
+  CommandStats &stats = commandStats[command.source];
+
+  stats.applied++;
+  stats.latencyTotal += latency;
+  if (latency > stats.latencyMax) stats.latencyMax = latency;
+}
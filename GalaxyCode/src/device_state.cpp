@@ -0,0 +1,82 @@
+#include "device_state.h"
+
+#include <atomic>
+
+// Number of 32-bit words needed to hold a DeviceState
+#define DEVICE_STATE_WORDS ((sizeof(DeviceState) + sizeof(uint32_t) - 1) / sizeof(uint32_t))
+
+// Seqlock sequence: odd while a write is in progress, and twice the version otherwise
+static std::atomic<uint32_t> sequence(0);
+
+// The published state, copied word by word so that a racing read is well defined
+static std::atomic<uint32_t> payload[DEVICE_STATE_WORDS];
+
+// Serialises writers; the writer's own copy of the state is only touched while holding it
+static portMUX_TYPE writeLock = portMUX_INITIALIZER_UNLOCKED;
+static DeviceState current;
+
+/**
+ * Store a state into the payload words. The caller must hold the write side of the seqlock.
+ */
+static void storePayload(const DeviceState &state) {
+  uint32_t words[DEVICE_STATE_WORDS] = {};
+  memcpy(words, &state, sizeof(state));
+  for (size_t i = 0; i < DEVICE_STATE_WORDS; i++) {
+    payload[i].store(words[i], std::memory_order_relaxed);
+  }
+}
+
+void deviceStateBegin(const DeviceState &initial) {
+  current = initial;
+  storePayload(initial);
+  sequence.store(0, std::memory_order_release);
+}
+
+uint32_t deviceStateRead(DeviceState &state) {
+  uint32_t words[DEVICE_STATE_WORDS];
+  uint32_t before, after;
+
+  do {
+    before = sequence.load(std::memory_order_acquire);
+    if (before & 1) {
+      // A writer is mid-update; it holds a critical section, so it finishes shortly
+      taskYIELD();
+      after = before + 1;
+      continue;
+    }
+    for (size_t i = 0; i < DEVICE_STATE_WORDS; i++) {
+      words[i] = payload[i].load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    after = sequence.load(std::memory_order_relaxed);
+  } while (before != after);
+
+  memcpy(&state, words, sizeof(state));
+  return before >> 1;
+}
+
+uint32_t deviceStateVersion() {
+  return sequence.load(std::memory_order_acquire) >> 1;
+}
+
+DeviceState deviceStateBeginUpdate() {
+  portENTER_CRITICAL(&writeLock);
+  return current;
+}
+
+uint32_t deviceStateCommitUpdate(const DeviceState &state) {
+  uint32_t seq = sequence.load(std::memory_order_relaxed);
+
+  if (!deviceStateEquals(state, current)) {
+    // Mark the payload as being written before touching it, and publish it once complete
+    sequence.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    storePayload(state);
+    seq += 2;
+    sequence.store(seq, std::memory_order_release);
+    current = state;
+  }
+
+  portEXIT_CRITICAL(&writeLock);
+  return seq >> 1;
+}
@@ -0,0 +1,69 @@
+#include "effects.h"
+
+#include "colour_cycle.h"
+
+// Phase accumulator for the colour cycle effect
+static ColourCycle colourCycle = {0, 0, COLOUR_CYCLE_PHASE_PER_MS};
+
+EffectStats effectStats[LedLast] = {};
+
+/**
+ * Scale full-scale RGBW levels by the brightness into a frame.
+ *
+ * The brightness is applied in fixed point, so no floating point is used on the render path.
+ */
+static void setRGBWLevels(OutputFrame &frame, uint32_t brightness,
+                          uint16_t red, uint16_t green, uint16_t blue, uint16_t white) {
+  frame.levels[RedChannel] = (red * brightness) >> 16;
+  frame.levels[GreenChannel] = (green * brightness) >> 16;
+  frame.levels[BlueChannel] = (blue * brightness) >> 16;
+  frame.levels[WhiteChannel] = (white * brightness) >> 16;
+}
+
+/**
+ * Render a static colour. The brightness presets are read straight from the compile-time
+ * palette table; a continuous brightness level is not in the table, so the colour is scaled
+ * at runtime instead.
+ */
+static void renderSolidEffect(RGBWStateEnum state, const EffectContext &context, OutputFrame &frame) {
+  if (!context.customBrightness) {
+    const RGBWLevels &levels = PALETTE_TABLE.levels[state][context.brightnessState];
+    frame.levels[RedChannel] = levels.red;
+    frame.levels[GreenChannel] = levels.green;
+    frame.levels[BlueChannel] = levels.blue;
+    frame.levels[WhiteChannel] = levels.white;
+    return;
+  }
+
+  const uint8_t *colour = RGBW_COLOURS[state];
+  setRGBWLevels(frame, context.brightness, outputLevelFrom8Bit(colour[0]), outputLevelFrom8Bit(colour[1]),
+                outputLevelFrom8Bit(colour[2]), outputLevelFrom8Bit(colour[3]));
+}
+
+/**
+ * Cycle through the colours using three sine waves a third of a turn apart.
+ */
+static void renderColourCycleEffect(RGBWStateEnum /*state*/, const EffectContext &context, OutputFrame &frame) {
+  uint16_t red, green, blue;
+  colourCycleAdvance(colourCycle, context.nowMillis);
+  colourCycleRender(colourCycle, red, green, blue);
+  setRGBWLevels(frame, context.brightness, red, green, blue, 0);
+}
+
+const EffectKind SolidEffect = {renderSolidEffect, false};
+const EffectKind ColourCycleEffect = {renderColourCycleEffect, true};
+
+#define EFFECT_ENTRY(name, emoji, red, green, blue, white, effect) {#name, &effect},
+const Effect EFFECTS[LedLast] = {RGBW_STATES(EFFECT_ENTRY)};
+
+void effectRender(RGBWStateEnum state, const EffectContext &context, OutputFrame &frame) {
+  uint32_t start = ESP.getCycleCount();
+  EFFECTS[state].kind->render(state, context, frame);
+  uint32_t cycles = ESP.getCycleCount() - start;
+
+  EffectStats &stats = effectStats[state];
+  if (!stats.renders || cycles < stats.minCycles) stats.minCycles = cycles;
+  if (cycles > stats.maxCycles) stats.maxCycles = cycles;
+  stats.totalCycles += cycles;
+  stats.renders++;
+}
@@ -0,0 +1,82 @@
+#include "gestures.h"
+
+enum GestureStateEnum {
+  GestureIdle,       // Released
+  GestureDown,       // Pressed, not yet long enough for a long press
+  GestureHeld,       // Long press reported, repeating while held
+  GestureTapped,     // Tap reported, waiting for a second press
+  GestureSecondDown, // Second press of a double press, waiting for the release
+  GestureStateLast
+};
+
+enum GestureInputEnum {
+  PressInput,
+  ReleaseInput,
+  TimeoutInput,
+  GestureInputLast
+};
+
+struct GestureTransition {
+  GestureStateEnum next;
+  GestureEnum gesture; // GestureLast reports nothing
+};
+
+// Next state and reported gesture for every state and input
+static const GestureTransition GESTURE_TRANSITIONS[GestureStateLast][GestureInputLast] = {
+  //                   Press                                Release                             Timeout
+  /* Idle */       {{GestureDown, GestureLast},             {GestureIdle, GestureLast},         {GestureIdle, GestureLast}},
+  /* Down */       {{GestureDown, GestureLast},             {GestureTapped, TapGesture},        {GestureHeld, LongPressGesture}},
+  /* Held */       {{GestureHeld, GestureLast},             {GestureIdle, GestureLast},         {GestureHeld, HoldRepeatGesture}},
+  /* Tapped */     {{GestureSecondDown, DoubleTapGesture},  {GestureTapped, GestureLast},       {GestureIdle, GestureLast}},
+  /* SecondDown */ {{GestureSecondDown, GestureLast},       {GestureIdle, GestureLast},         {GestureSecondDown, GestureLast}},
+};
+
+// Timeout armed on entering each state (ms), 0 for none
+static const uint16_t GESTURE_TIMEOUTS[GestureStateLast] = {
+  0, GESTURE_LONG_PRESS_MS, GESTURE_REPEAT_MS, GESTURE_DOUBLE_PRESS_MS, 0
+};
+
+/**
+ * Run one input through a switch's state machine, report the gesture and arm the next timeout.
+ */
+static void gestureStep(GestureRecogniser &recogniser, int button, GestureInputEnum input, uint32_t nowMillis) {
+  const GestureTransition &transition = GESTURE_TRANSITIONS[recogniser.states[button]][input];
+
+  recogniser.states[button] = transition.next;
+  recogniser.deadlines[button] = nowMillis + GESTURE_TIMEOUTS[transition.next];
+
+  if (transition.gesture != GestureLast && recogniser.handler) {
+    recogniser.handler(static_cast<SwitchEnum>(button), transition.gesture);
+  }
+}
+
+void gestureBegin(GestureRecogniser &recogniser, GestureHandler handler) {
+  for (int i = 0; i < SwitchLast; i++) {
+    recogniser.states[i] = GestureIdle;
+    recogniser.deadlines[i] = 0;
+  }
+  recogniser.handler = handler;
+}
+
+void gestureSwitchEvent(GestureRecogniser &recogniser, const SwitchEvent &event) {
+  gestureStep(recogniser, event.button, event.pressed ? PressInput : ReleaseInput, event.timeMillis);
+}
+
+uint32_t gestureTick(GestureRecogniser &recogniser, uint32_t nowMillis) {
+  uint32_t next = GESTURE_NO_DEADLINE;
+
+  for (int i = 0; i < SwitchLast; i++) {
+    if (!GESTURE_TIMEOUTS[recogniser.states[i]]) continue;
+
+    // Timestamps wrap, so compare the signed distance to the deadline
+    int32_t remaining = (int32_t)(recogniser.deadlines[i] - nowMillis);
+    if (remaining <= 0) {
+      gestureStep(recogniser, i, TimeoutInput, nowMillis);
+      if (!GESTURE_TIMEOUTS[recogniser.states[i]]) continue;
+      remaining = (int32_t)(recogniser.deadlines[i] - nowMillis);
+    }
+    if ((uint32_t)remaining < next) next = remaining;
+  }
+
+  return next;
+}
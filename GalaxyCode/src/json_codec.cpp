@@ -0,0 +1,208 @@
+#include "json_codec.h"
+
+#pragma region Writer
+/**
+ * Append characters, flagging an overflow rather than writing past the buffer.
+ */
+static void append(JsonWriter &writer, const char *data, size_t length) {
+  if (writer.overflow || writer.length + length >= writer.size) {
+    writer.overflow = true;
+    return;
+  }
+  memcpy(writer.buffer + writer.length, data, length);
+  writer.length += length;
+}
+
+static void append(JsonWriter &writer, char c) {
+  append(writer, &c, 1);
+}
+
+/**
+ * Start a value, with a comma if it follows another member or element.
+ */
+static void beginValue(JsonWriter &writer) {
+  if (writer.needComma) append(writer, ',');
+  writer.needComma = true;
+}
+
+void jsonWriterBegin(JsonWriter &writer, char *buffer, size_t size) {
+  writer = {buffer, size, 0, false, size == 0};
+}
+
+size_t jsonWriterEnd(JsonWriter &writer) {
+  if (writer.overflow) {
+    if (writer.size) writer.buffer[0] = '\0';
+    return 0;
+  }
+  writer.buffer[writer.length] = '\0';
+  return writer.length;
+}
+
+void jsonBeginObject(JsonWriter &writer) {
+  beginValue(writer);
+  append(writer, '{');
+  writer.needComma = false;
+}
+
+void jsonEndObject(JsonWriter &writer) {
+  append(writer, '}');
+  writer.needComma = true;
+}
+
+void jsonBeginArray(JsonWriter &writer) {
+  beginValue(writer);
+  append(writer, '[');
+  writer.needComma = false;
+}
+
+void jsonEndArray(JsonWriter &writer) {
+  append(writer, ']');
+  writer.needComma = true;
+}
+
+void jsonKey(JsonWriter &writer, const char *key) {
+  beginValue(writer);
+  append(writer, '"');
+  append(writer, key, strlen(key));
+  append(writer, "\":", 2);
+  writer.needComma = false;
+}
+
+void jsonUint(JsonWriter &writer, uint32_t value) {
+  // Digits are produced backwards into the end of a scratch buffer
+  char digits[10];
+  size_t start = sizeof(digits);
+  do {
+    digits[--start] = '0' + value % 10;
+    value /= 10;
+  } while (value);
+
+  beginValue(writer);
+  append(writer, digits + start, sizeof(digits) - start);
+}
+
+void jsonInt(JsonWriter &writer, int32_t value) {
+  if (value >= 0) {
+    jsonUint(writer, value);
+    return;
+  }
+  beginValue(writer);
+  append(writer, '-');
+  writer.needComma = false;
+  jsonUint(writer, 0U - (uint32_t)value);
+}
+
+void jsonBool(JsonWriter &writer, bool value) {
+  beginValue(writer);
+  if (value) {
+    append(writer, "true", 4);
+  } else {
+    append(writer, "false", 5);
+  }
+}
+
+void jsonString(JsonWriter &writer, const char *value) {
+  static const char HEX_DIGITS[] = "0123456789abcdef";
+
+  beginValue(writer);
+  append(writer, '"');
+  for (const char *c = value; *c; c++) {
+    if (*c == '"' || *c == '\\') {
+      append(writer, '\\');
+      append(writer, *c);
+    } else if ((uint8_t)*c < 0x20) {
+      char escape[] = {'\\', 'u', '0', '0', HEX_DIGITS[*c >> 4], HEX_DIGITS[*c & 0xF]};
+      append(writer, escape, sizeof(escape));
+    } else {
+      append(writer, *c);
+    }
+  }
+  append(writer, '"');
+}
+#pragma endregion
+
+#pragma region Tokenizer
+/**
+ * Match a literal such as "true" at the current position.
+ */
+static bool matchLiteral(JsonTokenizer &tokenizer, const char *literal) {
+  size_t length = strlen(literal);
+  if (tokenizer.length - tokenizer.position < length) return false;
+  if (memcmp(tokenizer.data + tokenizer.position, literal, length) != 0) return false;
+  tokenizer.position += length;
+  return true;
+}
+
+static bool isWhitespace(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+void jsonTokenizerBegin(JsonTokenizer &tokenizer, const char *data, size_t length) {
+  tokenizer = {data, length, 0};
+}
+
+bool jsonNextToken(JsonTokenizer &tokenizer, JsonToken &token) {
+  const char *data = tokenizer.data;
+  size_t &position = tokenizer.position;
+
+  // Skip whitespace
+  while (position < tokenizer.length && isWhitespace(data[position])) position++;
+
+  token = {JsonErrorToken, data + position, 0, 0};
+  if (position >= tokenizer.length) {
+    token.type = JsonEndToken;
+    return false;
+  }
+
+  char c = data[position];
+  switch (c) {
+    case '{': token.type = JsonObjectStartToken; position++; break;
+    case '}': token.type = JsonObjectEndToken; position++; break;
+    case '[': token.type = JsonArrayStartToken; position++; break;
+    case ']': token.type = JsonArrayEndToken; position++; break;
+    case ':': token.type = JsonColonToken; position++; break;
+    case ',': token.type = JsonCommaToken; position++; break;
+
+    case '"': {
+      size_t start = ++position;
+      while (position < tokenizer.length && data[position] != '"') {
+        // Skip the escaped character, so an escaped quote does not end the string
+        position += data[position] == '\\' ? 2 : 1;
+      }
+      if (position >= tokenizer.length) return false;
+      token = {JsonStringToken, data + start, position - start, 0};
+      position++;
+      break;
+    }
+
+    case 't': if (matchLiteral(tokenizer, "true")) token.type = JsonTrueToken; break;
+    case 'f': if (matchLiteral(tokenizer, "false")) token.type = JsonFalseToken; break;
+    case 'n': if (matchLiteral(tokenizer, "null")) token.type = JsonNullToken; break;
+
+    default: {
+      bool negative = c == '-';
+      if (negative) position++;
+
+      int64_t value = 0;
+      size_t digits = 0;
+      while (position < tokenizer.length && data[position] >= '0' && data[position] <= '9') {
+        value = value * 10 + (data[position++] - '0');
+        if (value > INT32_MAX) return false;
+        digits++;
+      }
+      if (!digits) return false;
+
+      token.type = JsonNumberToken;
+      token.number = negative ? -value : value;
+      break;
+    }
+  }
+
+  return token.type != JsonErrorToken;
+}
+
+bool jsonTokenEquals(const JsonToken &token, const char *string) {
+  return token.type == JsonStringToken && strlen(string) == token.length &&
+         memcmp(token.start, string, token.length) == 0;
+}
+#pragma endregion
@@ -3,25 +3,99 @@
 #include <AsyncTCP.h>
 #include <ESPAsyncWebServer.h>
 #include <AsyncElegantOTA.h>
-#include <Arduino_Json.h>
+
+#include <atomic>
+
+#include "command_dedupe.h"
+#include "command_queue.h"
+#include "device_state.h"
+#include "effects.h"
+#include "gestures.h"
+#include "json_codec.h"
+#include "output_driver.h"
+#include "render_scheduler.h"
+#include "states.h"
+#include "switch_input.h"
+#include "transition.h"
+#include "ws_buffers.h"
+#include "ws_clients.h"
+#include "ws_protocol.h"
 
 // Define and initialize the AsyncWebServer instance
 AsyncWebServer server(80);
 // Define and initialize the AsyncWebSocket instance
 AsyncWebSocket ws("/ws");
 
-// Task handles for the two core loops
+// Task handles for the two core loops and the state owner
 TaskHandle_t TaskLoopCore0;
 TaskHandle_t TaskLoopCore1;
+TaskHandle_t TaskStateOwner;
+
+// Brightness level variable: linear multiplier in 16.16 fixed point (65536 is full brightness).
+// Derived from the device state by the output task, and only used by it.
+uint32_t brightness = 0;
+
+// Output levels staged by the output handlers for the current state
+OutputFrame outputFrame = {};
+
+// Output levels actually on the outputs, which lag outputFrame while a transition runs
+OutputFrame displayedFrame = {};
+
+// Crossfade between the displayed frame and a new state's frame
+Transition transition = {{}, 0, TRANSITION_DURATION_MS, TransitionEasingEnum::SmoothEasing, false};
+
+// Output task instrumentation, used to measure the cost of keeping the outputs up to date.
+// Only stateChangedAt is written outside the output task, by whichever task changes the state.
+struct OutputStats {
+  std::atomic<uint32_t> stateChangedAt; // micros() timestamp of the most recent state change, 0 once rendered
+  unsigned long lastLatency;            // Time from the last state change to the new output (us)
+  unsigned long maxLatency;             // Worst observed state change to output time (us)
+  unsigned long renders;                // Number of times the outputs have been written
+  unsigned long busyTime;               // Total time spent writing the outputs (us)
+};
+OutputStats outputStats = {{0}, 0, 0, 0, 0};
+
+// Time state changes are collected for before they are broadcast to the WebSocket clients
+// together, so a burst of presses or a brightness ramp is sent as one up-to-date state
+#define BROADCAST_COALESCE_MS 20
+
+// Maximum number of acks held back until the broadcast of the state they refer to
+#define PENDING_ACKS_MAX 16
+
+// WebSocket broadcast instrumentation, used to measure the cost of keeping the clients up to date
+struct BroadcastStats {
+  unsigned long broadcasts; // Number of broadcasts that sent at least one message
+  unsigned long coalesced;  // State versions folded into a later broadcast instead of being sent
+  unsigned long messages;   // Messages queued to clients
+  unsigned long payloads;   // Payloads written into a pooled buffer, each shared by every client it is queued to
+  unsigned long bytes;      // Payload bytes queued to clients
+  unsigned long deferred;   // Updates put off to the next broadcast because no pooled buffer could be acquired
+};
+BroadcastStats broadcastStats = {0, 0, 0, 0, 0, 0};
+
+// An ack waiting for the broadcast of the state its command produced
+struct PendingAck {
+  uint32_t id;       // WebSocket client id
+  uint16_t sequence; // Sequence number of the command
+  uint32_t version;  // State version after the command
+};
+
+// Broadcast coalescing, only touched by the state owner
+bool broadcastPending = false;            // Whether there is anything to broadcast
+unsigned long broadcastPendingSince = 0;  // millis() timestamp of the oldest change not yet broadcast
+uint32_t broadcastVersion = 0;            // State version of the last broadcast
+PendingAck pendingAcks[PENDING_ACKS_MAX];
+int pendingAckCount = 0;
 
-// Switch state variables
-bool motorSwitchState = false;
-bool brightnessSwitchState = false;
-bool colourSwitchState = false;
-bool stateSwitchState = false;
+// Buffer sizes for the JSON documents: the state sent to JSON clients, and the /api reports
+#define JSON_STATE_SIZE 128
+#define JSON_REPORT_SIZE 2048
 
-// Brightness level variable
-float brightness = 0.0;
+// Largest request body accepted by the state API
+#define STATE_BODY_MAX 256
+
+// Random per-boot prefix of the state ETags, so a version from before a restart never matches
+uint32_t bootId = 0;
 
 // Maximum number of WiFi connection attempts
 #define MAX_WIFI_ATTEMPTS 10
@@ -34,38 +108,71 @@ bool wifiConnected = false;
 // Core task function declarations
 void LoopOutputHandle(void *pvParameters);
 void LoopStateHandle(void *pvParameters);
+void LoopStateOwner(void *pvParameters);
+
+// Function to apply a command from the command queue
+void applyCommand(const Command &command);
+
+// Function to wake the output task after a state change
+void notifyOutputTask();
 
 // Function to connect to WiFi
 void connectToWiFi();
 
 // State handling function declarations
-void setRGBWLed(int red, int green, int blue, int white);
-void handlePowerState();
-void handleRGBWState();
-void handleMotorState();
-void handleBrightnessState();
+void handlePowerState(const DeviceState &state);
+void handleRGBWState(const DeviceState &state, uint32_t nowMillis);
+void handleMotorState(const DeviceState &state);
+void handleBrightnessState(const DeviceState &state);
 
 // Switch handling function declarations
-void checkSwitch(int switchPin, bool &switchState, void (*callback)());
-void handleStateSwitch();
-void handleMotorSwitch();
-void handleBrightnessSwitch();
-void handleColourSwitch();
+void handleGesture(SwitchEnum button, GestureEnum gesture);
+void handleStateSwitch(int steps = 1);
+void handleMotorSwitch(int steps = 1);
+void handleBrightnessSwitch(int steps = 1);
+void handleColourSwitch(int steps = 1);
+void setBrightnessState(uint32_t value);
+void setBrightnessLevel(uint16_t level);
+void rampBrightnessLevel(int32_t change);
+void setFadeDuration(uint16_t durationMs);
+void applyStatePatch(const StatePatch &patch);
+void publishStateChange(const DeviceState &state);
+void scheduleBroadcast();
+void queueAck(uint32_t id, uint16_t sequence, uint32_t version);
+void broadcastState();
 
 // Template function for incrementing enums
 template <typename T>
-T incrementEnum(T &enumValue, T lastEnumValue);
+T incrementEnum(T &enumValue, T lastEnumValue, int steps = 1);
 
 // Template function for handling switch state changes
 template <typename EnumType>
-void handleSwitch(EnumType &enumState, EnumType lastEnumValue, const char *switchName);
+void handleSwitch(EnumType DeviceState::*field, EnumType lastEnumValue, const char *switchName, int steps);
+
+// Template function for setting an enumerated state
+template <typename EnumType>
+void setEnumState(EnumType DeviceState::*field, uint32_t value, EnumType lastEnumValue, const char *stateName);
 
 // WebSocket handling function declarations
 void onEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type,
              void *arg, uint8_t *data, size_t len);
-void handleWebSocketMessage(void *arg, uint8_t *payload, size_t length);
+void handleWebSocketMessage(AsyncWebSocketClient *client, void *arg, uint8_t *payload, size_t length);
+void handleTextMessage(AsyncWebSocketClient *client, uint8_t *payload, size_t length);
+void handleBinaryMessage(AsyncWebSocketClient *client, uint8_t *payload, size_t length);
+void submitSequencedCommand(AsyncWebSocketClient *client, const BinaryRequest &request);
+void sendAck(uint32_t id, uint16_t sequence, AckStatusEnum status, uint32_t version);
 void initWebSocket();
-String generateJsonForStates();
+size_t generateJsonForStates(const DeviceState &state, char *buffer, size_t size);
+bool parseJsonForStates(const char *data, size_t length, DeviceState &state, uint8_t &fields);
+size_t generateJsonForEffects(char *buffer, size_t size);
+size_t generateJsonForCommands(char *buffer, size_t size);
+size_t generateJsonForBroadcasts(char *buffer, size_t size);
+size_t generateJsonForClients(char *buffer, size_t size);
+void sendJsonReport(AsyncWebServerRequest *request, size_t (*generate)(char *buffer, size_t size));
+void formatStateETag(uint32_t version, char *buffer);
+void handleGetState(AsyncWebServerRequest *request);
+void handleSetState(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total);
+bool hasJsonBody(AsyncWebServerRequest *request);
 void updateClients();
 #pragma endregion
 
@@ -91,52 +198,31 @@ const IPAddress SUBNET(255, 255, 255, 0);
 #define BRIGHTNESS_SWITCH 25  // Brightness switch
 #define COLOUR_SWITCH 33      // Colour switch
 #define STATE_SWITCH 32       // State switch
-#pragma endregion
 
-#pragma region State Definitions
-// Enumerations for various states
-enum PowerStateEnum {
-  PowerOff,
-  On,
-  Project,
-  PowerLast
-};
-PowerStateEnum pStates = PowerOff;
-
-enum RGBWStateEnum {
-  Blue,
-  Red,
-  Green,
-  White,
-  BlueRed,
-  BlueGreen,
-  RedGreen,
-  RedWhite,
-  GreenWhite,
-  RedGreenBlue,
-  BlueGreenWhite,
-  BlueRedGreenWhite,
-  Cycle,
-  LedLast
-};
-RGBWStateEnum rgbwStates = Blue;
+// Output pins in the order of the output driver's channels
+const uint8_t OUTPUT_PINS[ChannelLast] = {RED_LED, GREEN_LED, BLUE_LED, WHITE_LED, PROJECTOR_LED, MOTOR_BJT};
 
-enum MotorStateEnum {
-  MotorOff,
-  Fast,
-  Slow,
-  MotorLast
+// Switch pins and the command each switch submits when pressed, in the order of SwitchEnum
+const uint8_t SWITCH_PINS[SwitchLast] = {MOTOR_SWITCH, BRIGHTNESS_SWITCH, COLOUR_SWITCH, STATE_SWITCH};
+const CommandTypeEnum SWITCH_COMMANDS[SwitchLast] = {MotorCommand, BrightnessCommand, ColourCommand, PowerCommand};
+
+// State each switch jumps to on a double press, in the order of SwitchEnum
+struct SwitchFavourite {
+  CommandTypeEnum command;
+  uint32_t value;
 };
-MotorStateEnum mStates = MotorOff;
-
-enum BrightnessStateEnum {
-  ExtraLow,
-  Low,
-  Medium,
-  High,
-  BrightnessLast
+const SwitchFavourite SWITCH_FAVOURITES[SwitchLast] = {
+  {SetMotorCommand, Fast}, {SetBrightnessCommand, High}, {SetColourCommand, Cycle}, {SetPowerCommand, Project}
 };
-BrightnessStateEnum bStates = ExtraLow;
+
+// Change of the continuous brightness level per hold repeat: the full range in about 2 seconds
+#define BRIGHTNESS_RAMP_STEP (BRIGHTNESS_LEVEL_MAX / (2000 / GESTURE_REPEAT_MS))
+#pragma endregion
+
+#pragma region State Definitions
+// State at boot; the current state is published in device_state.h and the enumerations are
+// generated in states.h
+const DeviceState INITIAL_STATE = {PowerOff, ExtraLow, Blue, MotorOff, 0, false, TRANSITION_DURATION_MS};
 #pragma endregion
 
 #pragma region HTML
@@ -225,6 +311,7 @@ const char index_html[] PROGMEM = R"rawliteral(
       <div class="card">
         <h2>Brightness</h2>
         <p><button id="Brightness" class="button">☀️</button></p>
+        <p><input type="range" id="BrightnessLevel" min="0" max="100" value="25"></p>
         <p class="state" id="BrightnessState">State: </p>
       </div>
       <div class="card">
@@ -244,16 +331,31 @@ const char index_html[] PROGMEM = R"rawliteral(
       var gateway = `ws://${window.location.hostname}/ws`;
       var websocket;
       var statesDict = {
-        "Power": ['🌑', '🌓', '🌕'],
-        "Brightness": ['🌒', '🌓', '🌔', '🌕'],
-        "Colour": ['🔵', '🔴', '🟢', '⚪️', '🔵🔴', '🔵🟢', '🔴🟢', '🔴⚪️', '🟢⚪️', '🔴🟢🔵', '🔵🟢⚪️', '🔵🔴🟢⚪️', '🔄'],
-        "Motor": ['🛑', '🐇', '🐢']
+        "Power": [)rawliteral" POWER_STATES(STATES_DICT_ENTRY) R"rawliteral(],
+        "Brightness": [)rawliteral" BRIGHTNESS_STATES(STATES_DICT_ENTRY) R"rawliteral(],
+        "Colour": [)rawliteral" RGBW_STATES(STATES_DICT_ENTRY) R"rawliteral(],
+        "Motor": [)rawliteral" MOTOR_STATES(STATES_DICT_ENTRY) R"rawliteral(]
       };
+      // Binary protocol (see ws_protocol.h): the fields in StateFieldEnum order, their sizes
+      // in bytes and the operation codes
+      var fields = ['Power', 'Brightness', 'Colour', 'Motor', 'CustomBrightness', 'BrightnessLevel', 'Fade'];
+      var fieldSizes = [1, 1, 1, 1, 1, 2, 2];
+      var SET = 0x10, INCREMENT = 0x20, SUBSCRIBE = 0x30, STATE = 0x40, HELLO = 0x50, SEQUENCED = 0x60, ACK = 0x70;
+      var ACK_BUSY = 2;
+      var BRIGHTNESS_LEVEL_MAX = 0xFFFF;
+      var states = {};
+      var stateVersion = 0;
+      // This page's own id, kept across reconnects, and the commands sent but not acknowledged
+      // yet, by sequence number
+      var clientId = crypto.getRandomValues(new Uint32Array(1))[0] || 1;
+      var sequence = 0;
+      var pending = {};
       window.addEventListener('load', onLoad);
   
       function initWebSocket() {
         console.log('Trying to open a WebSocket connection...');
-        websocket = new WebSocket(gateway);
+        websocket = new WebSocket(gateway, [')rawliteral" WS_BINARY_PROTOCOL R"rawliteral(']);
+        websocket.binaryType = 'arraybuffer';
         websocket.onopen    = onOpen;
         websocket.onclose   = onClose;
         websocket.onmessage = onMessage;
@@ -261,8 +363,11 @@ const char index_html[] PROGMEM = R"rawliteral(
   
       function onOpen(event) {
         console.log('Connection opened');
-        // Update the state of the buttons with the data received from the server
-        sendMessage('getStates');
+        sendFrame([HELLO, clientId & 0xFF, (clientId >> 8) & 0xFF, (clientId >> 16) & 0xFF, clientId >>> 24]);
+        // Subscribe to every field, which also sends the current state
+        sendFrame([SUBSCRIBE, (1 << fields.length) - 1]);
+        // Resend the commands the last connection did not acknowledge; the ESP skips any it applied
+        for (var seq in pending) sendFrame(pending[seq]);
       }
   
       function onClose(event) {
@@ -271,22 +376,48 @@ const char index_html[] PROGMEM = R"rawliteral(
       }
   
       function onMessage(event) {
-        console.log(`Received a message from server: ${event.data}`);
-        try {
-          var jsonData = JSON.parse(event.data);
-          updateStates(jsonData);
-        } catch (error) {
-          console.error('Error parsing JSON:', error);
+        var frame = new DataView(event.data);
+        if (frame.byteLength >= 8 && frame.getUint8(0) === ACK) {
+          onAck(frame.getUint16(1, true), frame.getUint8(3));
+          return;
         }
+        if (frame.byteLength < 6 || frame.getUint8(0) !== STATE) return;
+
+        // State delta: version, mask of the fields present, then the fields' values
+        stateVersion = frame.getUint32(1, true);
+        var mask = frame.getUint8(5);
+        var offset = 6;
+        for (var field = 0; field < fields.length; field++) {
+          if (!(mask & (1 << field))) continue;
+          states[fields[field]] = fieldSizes[field] == 2 ? frame.getUint16(offset, true) : frame.getUint8(offset);
+          offset += fieldSizes[field];
+        }
+        console.log(`Received state version ${stateVersion}`);
+        updateStates();
       }
   
-      function updateStates(data) {
-        for (var key in data) {
+      function onAck(seq, status) {
+        if (status === ACK_BUSY) {
+          // The ESP was too busy to queue the command, so try again shortly
+          setTimeout(function() { if (pending[seq]) sendFrame(pending[seq]); }, 100);
+        } else {
+          delete pending[seq];
+        }
+      }
+  
+      function updateStates() {
+        for (var key in statesDict) {
           var stateElement = document.getElementById(key + 'State');
-          if (stateElement) {
-            stateElement.textContent = 'State: ' + statesDict[key][data[key]];
+          if (stateElement && key in states) {
+            stateElement.textContent = 'State: ' + statesDict[key][states[key]];
           }
         }
+        // A continuous brightness level replaces the brightness step
+        if (states.CustomBrightness) {
+          var percent = Math.round(states.BrightnessLevel * 100 / BRIGHTNESS_LEVEL_MAX);
+          document.getElementById('BrightnessState').textContent = 'State: ' + percent + '%';
+          document.getElementById('BrightnessLevel').value = percent;
+        }
       }
   
       function onLoad(event) {
@@ -300,18 +431,33 @@ const char index_html[] PROGMEM = R"rawliteral(
         addButtonListener("Brightness");
         addButtonListener("Colour");
         addButtonListener("Motor");
+
+        // The brightness slider sets a continuous level
+        document.getElementById("BrightnessLevel").addEventListener('change', function() {
+          var level = Math.round(this.value * BRIGHTNESS_LEVEL_MAX / 100);
+          sendCommand([SET | fields.indexOf('BrightnessLevel'), level & 0xFF, level >> 8]);
+        });
       }
   
       function addButtonListener(buttonId) {
         var button = document.getElementById(buttonId);
         button.addEventListener('click', function() {
-          sendMessage(buttonId);
+          // Step the button's state forward by one
+          sendCommand([INCREMENT | fields.indexOf(buttonId), 1]);
         });
         button.buttonId = buttonId; // Store the button's id as a property for later use
       }
   
-      function sendMessage(buttonId) {
-        websocket.send(buttonId); // Send the button's id as a message to the ESP
+      function sendCommand(bytes) {
+        // Number the command, so it is applied once however often it is resent
+        sequence = (sequence + 1) & 0xFFFF;
+        var frame = [SEQUENCED, sequence & 0xFF, sequence >> 8].concat(bytes);
+        pending[sequence] = frame;
+        if (websocket.readyState === WebSocket.OPEN) sendFrame(frame);
+      }
+  
+      function sendFrame(bytes) {
+        websocket.send(new Uint8Array(bytes)); // Send the frame to the ESP
       }
     </script>
 </body>
@@ -323,19 +469,17 @@ void setup() {
   Serial.begin(115200);
   Serial.println("Booting");
 
+  // Publish the initial state and open the command queue before any input can arrive
+  deviceStateBegin(INITIAL_STATE);
+  commandQueueBegin();
+  bootId = esp_random();
+
   #pragma region Pin Initialisation
-  pinMode(RED_LED, OUTPUT);
-  pinMode(WHITE_LED, OUTPUT);
-  pinMode(GREEN_LED, OUTPUT);
-  pinMode(BLUE_LED, OUTPUT);
-  pinMode(PROJECTOR_LED, OUTPUT);
-  pinMode(MOTOR_BJT, OUTPUT);
+  // The LED, projector and motor outputs are driven by LEDC channels
+  outputBegin(OUTPUT_PINS);
   
-  // Switches are active low so use INPUT_PULLUP
-  pinMode(MOTOR_SWITCH, INPUT_PULLUP);
-  pinMode(BRIGHTNESS_SWITCH, INPUT_PULLUP);
-  pinMode(COLOUR_SWITCH, INPUT_PULLUP);
-  pinMode(STATE_SWITCH, INPUT_PULLUP);
+  // Switches are active low inputs that interrupt on every edge
+  switchInputBegin(SWITCH_PINS);
   #pragma endregion
 
   connectToWiFi();
@@ -344,6 +488,7 @@ void setup() {
     // Initialise WebSocket
     Serial.println("Initialising WebSocket");
     initWebSocket();
+    wsBuffersBegin();
     Serial.println("WebSocket initialised");
 
     // Initialise OTA
@@ -351,6 +496,28 @@ void setup() {
     server.on("/", HTTP_GET, [](AsyncWebServerRequest *request) {
       request->send_P(200, "text/html", index_html);
     });
+    server.on("/api/effects", HTTP_GET, [](AsyncWebServerRequest *request) {
+      sendJsonReport(request, generateJsonForEffects);
+    });
+    server.on("/api/commands", HTTP_GET, [](AsyncWebServerRequest *request) {
+      sendJsonReport(request, generateJsonForCommands);
+    });
+    server.on("/api/broadcasts", HTTP_GET, [](AsyncWebServerRequest *request) {
+      sendJsonReport(request, generateJsonForBroadcasts);
+    });
+    server.on("/api/clients", HTTP_GET, [](AsyncWebServerRequest *request) {
+      sendJsonReport(request, generateJsonForClients);
+    });
+    server.on("/api/state", HTTP_GET, handleGetState);
+    server.on("/api/state", HTTP_PUT | HTTP_PATCH, [](AsyncWebServerRequest *request) {
+      // Requests with a JSON body were answered by the body handler; any other body was
+      // parsed as form parameters or ignored, so it must be refused here
+      if (!hasJsonBody(request)) {
+        request->send(415, "text/plain", "State must be application/json");
+      } else if (!request->contentLength()) {
+        request->send(400, "text/plain", "Missing state");
+      }
+    }, nullptr, handleSetState);
     AsyncElegantOTA.begin(&server);    // Start AsyncElegantOTA
     server.begin();
     Serial.println("HTTP server started");
@@ -369,10 +536,24 @@ void setup() {
     10000,                /* Stack size of task */
     NULL,                 /* parameter of the task */
     1,                    /* priority of the task */
-    &TaskLoopCore0,       /* Task handle to keep track of created task */
+    &TaskLoopCore1,       /* Task handle to keep track of created task */
     1);                   /* pin task to core 1 */          
   delay(500); 
 
+  // The state owner runs above TaskLoopCore0, the switch input task, which sleeps until a
+  // switch edge interrupt or a debounce esp_timer expiry queues a signal and then submits
+  // the recognised gestures as commands; the owner preempts it to apply each command
+  Serial.print("Initialising TaskStateOwner... ");
+  xTaskCreatePinnedToCore(
+    LoopStateOwner,       /* Task function. */
+    "TaskStateOwner",     /* name of task. */
+    10000,                /* Stack size of task */
+    NULL,                 /* parameter of the task */
+    2,                    /* priority of the task, above the switch input task */
+    &TaskStateOwner,      /* Task handle to keep track of created task */
+    0);                   /* pin task to core 0 */
+  delay(500);
+
   Serial.print("Initialising TaskLoopCore0... ");
   xTaskCreatePinnedToCore(
     LoopStateHandle,      /* Task function. */
@@ -380,7 +561,7 @@ void setup() {
     10000,                /* Stack size of task */
     NULL,                 /* parameter of the task */
     1,                    /* priority of the task */
-    &TaskLoopCore1,       /* Task handle to keep track of created task */
+    &TaskLoopCore0,       /* Task handle to keep track of created task */
     0);                   /* pin task to core 0 */
   delay(500); 
 
@@ -438,8 +619,11 @@ void loop() {
  * Task function to handle the output loop on a specific core.
  *
  * This task function is responsible for managing the output-related operations
- * of the device. It continuously handles the power state, brightness state,
- * RGBW state, and motor state according to their respective conditions.
+ * of the device. It writes the power state, brightness state, RGBW state and motor
+ * state to the outputs, then hands over to the render scheduler. A state change starts
+ * a crossfade from the displayed output to the new one. While an animated colour mode
+ * or a crossfade is active the scheduler wakes the task at a fixed frame rate; otherwise
+ * the task sleeps until it is notified of a state change.
  *
  * @param pvParameters A pointer to the parameters passed to the task (not used in this case).
  */
@@ -448,32 +632,81 @@ void LoopOutputHandle(void *pvParameters) {
   Serial.print("TaskLoopCore1 running on core ");
   Serial.println(xPortGetCoreID());
 
+  // Version of the state already applied to the outputs
+  uint32_t appliedVersion = 0;
+
   // Enter the main loop
   for (;;) {
+    unsigned long renderStart = micros();
+    renderSchedulerBeginFrame();
+    uint32_t frameMillis = millis();
+
+    // Render the whole frame from one consistent snapshot of the state
+    DeviceState state;
+    uint32_t version = deviceStateRead(state);
+
+    // Fade from whatever is displayed now towards the new state
+    if (version != appliedVersion) {
+      appliedVersion = version;
+      transition.durationMs = state.fadeMs;
+      transitionStart(transition, displayedFrame, frameMillis);
+    }
+
     // Handle power state regardless of other states
-    handlePowerState();
+    handlePowerState(state);
 
     // Skip handling other states if the device is powered off
-    if (pStates == PowerStateEnum::PowerOff) {
-      continue;
+    if (state.power != PowerStateEnum::PowerOff) {
+      // Handle brightness state
+      handleBrightnessState(state);
+
+      // Handle RGBW state
+      handleRGBWState(state, frameMillis);
+
+      // Handle motor state
+      handleMotorState(state);
     }
 
-    // Handle brightness state
-    handleBrightnessState();
+    transitionApply(transition, outputFrame, frameMillis, displayedFrame);
+
+    // Keep animating while the colour cycles or a fade runs, otherwise sleep until the state changes
+    bool animated = (state.power != PowerStateEnum::PowerOff && effectIsAnimated(state.colour)) || transition.active;
 
-    // Handle RGBW state
-    handleRGBWState();
+    // Apply all the output levels at once, dithered while they are refreshed every frame
+    outputCommit(displayedFrame, animated);
 
-    // Handle motor state
-    handleMotorState();
+    unsigned long renderEnd = micros();
+    outputStats.renders++;
+    outputStats.busyTime += renderEnd - renderStart;
+
+    // Measure how long the last state change took to reach the outputs (see /api/effects)
+    uint32_t stateChangedAt = outputStats.stateChangedAt.exchange(0);
+    if (stateChangedAt) {
+      outputStats.lastLatency = renderEnd - stateChangedAt;
+      if (outputStats.lastLatency > outputStats.maxLatency) outputStats.maxLatency = outputStats.lastLatency;
+    }
+
+    renderSchedulerWait(animated);
   }
 }
 
+/**
+ * Wake the output task so that it applies the current state.
+ *
+ * Must be called after every published state change. The output task picks up the change
+ * from the state version; notifications received while it is busy are latched, so a change
+ * made during an update is never lost.
+ */
+void notifyOutputTask() {
+  outputStats.stateChangedAt = micros();
+  if (TaskLoopCore1) xTaskNotifyGive(TaskLoopCore1);
+}
+
 /**
  * Handle power state and associated actions.
  *
  * This function is responsible for handling the power state of the device and
- * performing relevant actions based on the current power state. It controls the
+ * performing relevant actions based on the current power state. It stages the
  * LED colors, projector state, and motor state according to the power state.
  * If the power state is not recognized, an error message is printed to the serial monitor.
  *
@@ -483,24 +716,21 @@ void LoopOutputHandle(void *pvParameters) {
  *   - Project: Activates the projector and allows other state handlers to be executed.
  *     The projector LED will be on in this state.
  */
-void handlePowerState() {
-  switch (pStates) {
+void handlePowerState(const DeviceState &state) {
+  switch (state.power) {
     case PowerStateEnum::PowerOff:
       // Turn off all LEDs and deactivate the projector and motor
-      analogWrite(RED_LED, 0);
-      analogWrite(GREEN_LED, 0);
-      analogWrite(BLUE_LED, 0);
-      analogWrite(WHITE_LED, 0);
-      digitalWrite(PROJECTOR_LED, LOW);
-      analogWrite(MOTOR_BJT, 0);
+      outputFrame = {};
       break;
     case PowerStateEnum::On:
+      // Deactivate the projector
+      outputFrame.levels[ProjectorChannel] = 0;
       // Being in this state allows the other states to be handled
       // Otherwise, the other state handlers will be skipped
       break;
     case PowerStateEnum::Project:
       // Activate the projector
-      digitalWrite(PROJECTOR_LED, HIGH);
+      outputFrame.levels[ProjectorChannel] = OUTPUT_LEVEL_MAX;
       // Being in this state allows the other states to be handled
       // Otherwise, the other state handlers will be skipped
       // In this case, the projector LED will be on as well.
@@ -516,264 +746,474 @@ void handlePowerState() {
  * Handle brightness state and set the global brightness level modifier.
  *
  * This function is responsible for adjusting the global brightness level modifier of the
- * device's LED colors based on the current brightness state. The brightness level
- * is controlled by modifying the 'brightness' variable. If the brightness state is
- * not recognized, an error message is printed to the serial monitor.
- *
- * @remarks The function behaviors in different brightness states:
- *   - ExtraLow: Sets the brightness to 25% of the maximum level.
- *   - Low: Sets the brightness to 50% of the maximum level.
- *   - Medium: Sets the brightness to 75% of the maximum level.
- *   - High: Sets the brightness to the maximum level (100%).
- */
-void handleBrightnessState() {
-  switch (bStates) {
-    case BrightnessStateEnum::ExtraLow:
-      // Set the brightness to 25% of the maximum level
-      brightness = 0.25;
-      break;
-    case BrightnessStateEnum::Low:
-      // Set the brightness to 50% of the maximum level
-      brightness = 0.5;
-      break;
-    case BrightnessStateEnum::Medium:
-      // Set the brightness to 75% of the maximum level
-      brightness = 0.75;
-      break;
-    case BrightnessStateEnum::High:
-      // Set the brightness to the maximum level (100%)
-      brightness = 1;
-      break;
-    default:
-      // Print an error message for unrecognized brightness state
-      Serial.println("Invalid Brightness State");
-      break;
+ * device's LED colors based on the current brightness state, or on the continuous
+ * brightness level if one has been set. The brightness level is controlled by modifying
+ * the 'brightness' variable, which holds the gamma-corrected linear multiplier for the
+ * perceptual level. If the brightness state is not recognized, an error message is
+ * printed to the serial monitor.
+ */
+void handleBrightnessState(const DeviceState &state) {
+  if (state.customBrightness) {
+    brightness = brightnessLevelToScale(state.brightnessLevel);
+    return;
   }
+
+  if (state.brightness >= BrightnessStateEnum::BrightnessLast) {
+    // Print an error message for unrecognized brightness state
+    Serial.println("Invalid Brightness State");
+    return;
+  }
+
+  brightness = BRIGHTNESS_SCALES[state.brightness];
 }
 
 /**
  * Handle RGBW state and set the RGBW LED colors based on the current state.
  *
  * This function is responsible for setting the RGBW LED colors based on the current
- * RGBW state. The RGBW LED colors are determined by the 'rgbwStates' variable.
- * If the RGBW state is not recognized, an error message is printed to the serial monitor.
+ * RGBW state, by rendering the state's effect from the effect engine for the current
+ * frame. If the RGBW state is not recognized, an error message is printed to the serial
+ * monitor.
+ *
+ * @param state The state snapshot being rendered.
+ * @param nowMillis The frame timestamp in milliseconds.
+ */
+void handleRGBWState(const DeviceState &state, uint32_t nowMillis) {
+  if (state.colour >= RGBWStateEnum::LedLast) {
+    Serial.println("Invalid RGBW State");
+    return;
+  }
+
+  EffectContext context = {nowMillis, state.brightness, brightness, state.customBrightness};
+  effectRender(state.colour, context, outputFrame);
+}
+
+/**
+ * Handle motor state and control the motor speed based on the current state.
+ *
+ * This function is responsible for controlling the motor speed based on the current
+ * motor state. The motor speed is controlled by adjusting the PWM duty of the
+ * MOTOR_BJT pin to the speed defined for each state in MOTOR_STATES. If the motor
+ * state is not recognized, an error message is printed to the serial monitor.
+ */
+void handleMotorState(const DeviceState &state) {
+  if (state.motor >= MotorStateEnum::MotorLast) {
+    // Print an error message for unrecognized motor state
+    Serial.println("Invalid Motor State");
+    return;
+  }
+
+  outputFrame.levels[MotorChannel] = MOTOR_LEVELS[state.motor];
+}
+#pragma endregion
+
+#pragma region State Handlers
+/**
+ * Task function for the state owner.
+ *
+ * This task is the only place the device state is changed. It sleeps until a command is
+ * submitted by a switch or the web interface, then applies every queued command, switch
+ * commands first. All the follow-up work of a state change (serial logging, waking the
+ * output task and broadcasting to the WebSocket clients) runs here, never in the input
+ * sources.
+ *
+ * The outputs follow every change at once, but the WebSocket clients are sent the state
+ * BROADCAST_COALESCE_MS after the first change that has not been broadcast yet, so the
+ * changes that arrive in between are sent as one state. Acks wait for that broadcast.
+ *
+ * @param pvParameters Pointer to task parameters (not used in this case).
+ */
+void LoopStateOwner(void *pvParameters) {
+  Serial.print("TaskStateOwner running on core ");
+  Serial.println(xPortGetCoreID());
+
+  commandQueueSetOwner(xTaskGetCurrentTaskHandle());
+  wsClientsSetOwner(xTaskGetCurrentTaskHandle());
+
+  for (;;) {
+    Command command;
+    while (commandReceive(command)) {
+      applyCommand(command);
+      commandComplete(command);
+
+      // Acknowledge sequenced commands after the state push they caused
+      if (command.replyTo) queueAck(command.replyTo, command.sequence, deviceStateVersion());
+    }
+
+    // A slow client has sent its last state, so the one that waited for it can go
+    if (wsClientsTakeReady()) scheduleBroadcast();
+
+    // Sleep until the next command is submitted, or until the pending broadcast is due
+    TickType_t timeout = portMAX_DELAY;
+    if (broadcastPending) {
+      unsigned long elapsed = millis() - broadcastPendingSince;
+      if (elapsed >= BROADCAST_COALESCE_MS || pendingAckCount == PENDING_ACKS_MAX) {
+        broadcastState();
+        continue;
+      }
+      timeout = pdMS_TO_TICKS(BROADCAST_COALESCE_MS - elapsed);
+      if (!timeout) timeout = 1;
+    }
+    ulTaskNotifyTake(pdTRUE, timeout);
+  }
+}
+
+/**
+ * Apply a command from the command queue to the device state.
+ *
+ * @param command The command to apply.
  */
-void handleRGBWState() {
-  switch(rgbwStates) {
-    case RGBWStateEnum::Blue:
-      setRGBWLed(0, 0, 255, 0);
+void applyCommand(const Command &command) {
+  switch (command.type) {
+    case PowerCommand:
+      handleStateSwitch((int32_t)command.value);
       break;
-    case RGBWStateEnum::Red:
-      setRGBWLed(255, 0, 0, 0);
+    case BrightnessCommand:
+      handleBrightnessSwitch((int32_t)command.value);
       break;
-    case RGBWStateEnum::Green:
-      setRGBWLed(0, 255, 0, 0);
+    case ColourCommand:
+      handleColourSwitch((int32_t)command.value);
       break;
-    case RGBWStateEnum::White:
-      setRGBWLed(0, 0, 0, 255);
+    case MotorCommand:
+      handleMotorSwitch((int32_t)command.value);
       break;
-    case RGBWStateEnum::BlueRed:
-      setRGBWLed(255, 0, 255, 0);
+    case SetPowerCommand:
+      setEnumState(&DeviceState::power, command.value, PowerStateEnum::PowerLast, "Power");
       break;
-    case RGBWStateEnum::BlueGreen:
-      setRGBWLed(0, 255, 255, 0);
+    case SetBrightnessCommand:
+      setBrightnessState(command.value);
       break;
-    case RGBWStateEnum::RedGreen:
-      setRGBWLed(255, 255, 0, 0);
+    case SetColourCommand:
+      setEnumState(&DeviceState::colour, command.value, RGBWStateEnum::LedLast, "Colour");
       break;
-    case RGBWStateEnum::RedWhite:
-      setRGBWLed(255, 0, 0, 255);
+    case SetMotorCommand:
+      setEnumState(&DeviceState::motor, command.value, MotorStateEnum::MotorLast, "Motor");
       break;
-    case RGBWStateEnum::GreenWhite:
-      setRGBWLed(0, 255, 0, 255);
+    case BrightnessLevelCommand:
+      setBrightnessLevel(command.value);
       break;
-    case RGBWStateEnum::RedGreenBlue:
-      setRGBWLed(255, 255, 255, 0);
+    case BrightnessRampCommand:
+      rampBrightnessLevel((int32_t)command.value);
       break;
-    case RGBWStateEnum::BlueGreenWhite:
-      setRGBWLed(0, 255, 255, 255);
+    case FadeCommand:
+      setFadeDuration(command.value);
       break;
-    case RGBWStateEnum::BlueRedGreenWhite:
-      setRGBWLed(255, 255, 255, 255);
+    case GetStatesCommand:
+      // The value is the id of the client asking for the whole state
+      wsClientResync(command.value);
+      scheduleBroadcast();
       break;
-    case RGBWStateEnum::Cycle:
-      // Cycle through the colours using a sine wave on millis()
-      setRGBWLed(
-        127.5 * (1 + sin(millis() / 1000.0)),               // Red
-        127.5 * (1 + sin(millis() / 1000.0 + 2 * PI / 3)),  // Green
-        127.5 * (1 + sin(millis() / 1000.0 + 4 * PI / 3)),  // Blue
-        0);                                                 // White
+    case PatchStateCommand: {
+      StatePatch patch;
+      commandTakePatch(command, patch);
+      applyStatePatch(patch);
       break;
+    }
     default:
-      Serial.println("Invalid RGBW State");
+      Serial.println("Invalid Command");
       break;
   }
 }
 
 /**
- * Handle motor state and control the motor speed based on the current state.
+ * Task function for handling the switches.
  *
- * This function is responsible for controlling the motor speed based on the current
- * motor state. The motor speed is controlled by adjusting the analog output value
- * to the MOTOR_BJT pin. If the motor state is not recognized, an error message is
- * printed to the serial monitor.
+ * This task function sleeps until a switch interrupt reports a debounced press or release,
+ * or until the gesture recogniser's next timeout, and turns the recognised gestures into
+ * commands for the state owner. It does not poll, so it costs no CPU time while the switches
+ * are untouched.
+ *
+ * @param pvParameters Pointer to task parameters (not used in this case).
+ */
+void LoopStateHandle( void * pvParameters ){
+  Serial.print("TaskLoopCore0 running on core ");
+  Serial.println(xPortGetCoreID());
+
+  GestureRecogniser gestures;
+  gestureBegin(gestures, handleGesture);
+
+  for(;;){
+    // Fire any expired gesture timeouts, then wait for a switch or the next timeout
+    uint32_t waitMs = gestureTick(gestures, millis());
+    TickType_t waitTicks = waitMs == GESTURE_NO_DEADLINE ? portMAX_DELAY : pdMS_TO_TICKS(waitMs) + 1;
+
+    SwitchEvent event;
+    if (switchInputReceive(event, waitTicks)) gestureSwitchEvent(gestures, event);
+  }
+}
+
+/**
+ * Turn a switch gesture into a command for the state owner.
+ *
+ * A tap steps the switch's state forward and a long press steps it back, except on the
+ * brightness switch, where holding the switch ramps the continuous brightness level instead
+ * (alternately up and down on successive holds). A double press jumps straight to the
+ * switch's favourite state; it is an absolute set, so the tap reported just before it does
+ * not matter.
  *
- * @remarks The function behaviors in different motor states:
- *   - MotorOff: Turns off the motor by setting analog output to 0.
- *   - Fast: Sets the motor speed to maximum (255) using analog output.
- *   - Slow: Sets the motor speed to a moderate value (200) using analog output.
+ * @param button The switch that made the gesture.
+ * @param gesture The gesture.
  */
-void handleMotorState() {
-  switch (mStates) {
-    case MotorStateEnum::MotorOff:
-      // Turn off the motor by setting analog output to 0
-      analogWrite(MOTOR_BJT, 0);
+void handleGesture(SwitchEnum button, GestureEnum gesture) {
+  static bool rampUp = false;
+
+  switch (gesture) {
+    case TapGesture:
+      commandSubmit(SWITCH_COMMANDS[button], SwitchSource, 1);
       break;
-    case MotorStateEnum::Fast:
-      // Set the motor speed to maximum (255) using analog output
-      analogWrite(MOTOR_BJT, 255);
+    case DoubleTapGesture:
+      commandSubmit(SWITCH_FAVOURITES[button].command, SwitchSource, SWITCH_FAVOURITES[button].value);
       break;
-    case MotorStateEnum::Slow:
-      // Set the motor speed to a moderate value (200) using analog output
-      analogWrite(MOTOR_BJT, 200);
+    case LongPressGesture:
+      if (button == BrightnessSwitch) {
+        rampUp = !rampUp;
+        commandSubmit(BrightnessRampCommand, SwitchSource, rampUp ? BRIGHTNESS_RAMP_STEP : -BRIGHTNESS_RAMP_STEP);
+      } else {
+        commandSubmit(SWITCH_COMMANDS[button], SwitchSource, (uint32_t)-1);
+      }
+      break;
+    case HoldRepeatGesture:
+      if (button == BrightnessSwitch) {
+        commandSubmit(BrightnessRampCommand, SwitchSource, rampUp ? BRIGHTNESS_RAMP_STEP : -BRIGHTNESS_RAMP_STEP);
+      }
       break;
     default:
-      // Print an error message for unrecognized motor state
-      Serial.println("Invalid Motor State");
       break;
   }
 }
 
+
 /**
- * Set the RGBW LED color and adjust brightness.
- *
- * This function sets the color of the RGBW LED by adjusting the analog output values
- * for each color channel (red, green, blue, white) based on the specified values
- * and the current brightness level. The brightness factor is multiplied with the
- * input color values to control the overall brightness of the LED.
+ * Step the power state, as the state switch does.
  *
- * @param red The intensity of the red color channel (0-255).
- * @param green The intensity of the green color channel (0-255).
- * @param blue The intensity of the blue color channel (0-255).
- * @param white The intensity of the white color channel (0-255).
+ * @param steps Number of states to step forward, or backward if negative.
  */
-void setRGBWLed(int red, int green, int blue, int white) {
-  // Adjust the color intensity using the current brightness level
-  analogWrite(RED_LED, red * brightness);
-  analogWrite(GREEN_LED, green * brightness);
-  analogWrite(BLUE_LED, blue * brightness);
-  analogWrite(WHITE_LED, white * brightness);
+void handleStateSwitch(int steps) {
+  handleSwitch(&DeviceState::power, PowerStateEnum::PowerLast, "Power", steps);
 }
-#pragma endregion
 
-#pragma region State Handlers
 /**
- * Task function for monitoring and handling switch states.
+ * Step the motor speed, as the motor switch does.
  *
- * This task function is responsible for continuously monitoring the states of various switches
- * and invoking their corresponding handler functions when the switches are pressed or released.
- * The function includes a delay to prevent excessive CPU usage within the loop.
+ * @param steps Number of speeds to step forward, or backward if negative.
+ */
+void handleMotorSwitch(int steps) {
+  handleSwitch(&DeviceState::motor, MotorStateEnum::MotorLast, "Motor", steps);
+}
+
+/**
+ * Step the brightness through its preset levels, as the brightness switch does.
  *
- * @param pvParameters Pointer to task parameters (not used in this case).
+ * @param steps Number of levels to step forward, or backward if negative.
  */
-void LoopStateHandle( void * pvParameters ){
-  Serial.print("TaskLoopCore1 running on core ");
-  Serial.println(xPortGetCoreID());
+void handleBrightnessSwitch(int steps) {
+  DeviceState state = deviceStateBeginUpdate();
+  // Stepping the brightness returns to the preset levels
+  state.customBrightness = false;
+  incrementEnum(state.brightness, BrightnessStateEnum::BrightnessLast, steps);
+  publishStateChange(state);
+  Serial.printf("Brightness Switch Pressed - %d\n", static_cast<int>(state.brightness));
+}
 
-  for(;;){
-    // Check the states of various switches and invoke their handlers
-    checkSwitch(MOTOR_SWITCH, motorSwitchState, handleMotorSwitch);
-    checkSwitch(BRIGHTNESS_SWITCH, brightnessSwitchState, handleBrightnessSwitch);
-    checkSwitch(COLOUR_SWITCH, colourSwitchState, handleColourSwitch);
-    checkSwitch(STATE_SWITCH, stateSwitchState, handleStateSwitch);
-    
-    // Delay for 10ms to prevent the task from hogging the CPU
-    vTaskDelay(10 / portTICK_PERIOD_MS);
+/**
+ * Set the brightness to one of the preset steps, leaving any continuous brightness level.
+ *
+ * @param value The BrightnessStateEnum to set; out of range values are ignored.
+ */
+void setBrightnessState(uint32_t value) {
+  if (value >= BrightnessStateEnum::BrightnessLast) {
+    Serial.println("Invalid Brightness State");
+    return;
   }
-}
 
+  DeviceState state = deviceStateBeginUpdate();
+  state.customBrightness = false;
+  state.brightness = static_cast<BrightnessStateEnum>(value);
+  publishStateChange(state);
+  Serial.printf("Brightness Set - %u\n", value);
+}
 
 /**
- * Checks the state of a switch connected to the specified pin and updates the switch state accordingly.
- * 
- * @param switchPin The digital pin to which the switch is connected.
- * @param switchState A reference to a boolean variable representing the current state of the switch.
- *                    This variable will be updated based on the switch's state.
- * @param callback A callback function that will be called when the switch is pressed.
- *                 The callback function should have the signature: void functionName()
- */
-void checkSwitch(int switchPin, bool &switchState, void (*callback)()) {
-  static unsigned long lastDebounceTime = 0;
-  static unsigned long timeReleased = 0;    // Using static variables to preserve state between function calls
-  const unsigned long debounceDelay = 100;   // Debounce delay in milliseconds
-  unsigned long currentMillis = millis();
-
-  int switchReading = digitalRead(switchPin);
-
-  if (switchReading == LOW) { // If the switch is pressed
-    if (!switchState) {
-      switchState = true;
-      callback(); // Call the callback function
-    }
-  } // No time debounce is required for the switch being pressed as the change in state provides this functionality
-  
-  else { // If the switch is released
-    // Calculate the time since the switch was released
-    unsigned long timeSinceRelease = currentMillis - timeReleased;
-    if(switchState && timeSinceRelease > debounceDelay) {
-      switchState = false;
-      timeReleased = currentMillis;
-    }
-  } // A debounce delay is required for the switch being released as the change in state does not prevent the switch from activating immediately after being released
+ * Set a continuous brightness level instead of one of the brightness steps.
+ *
+ * The level is perceptual, so it is gamma corrected before being applied to the outputs.
+ * Pressing the brightness switch afterwards returns to stepping through the presets.
+ *
+ * @param level The perceptual brightness level (0-BRIGHTNESS_LEVEL_MAX).
+ */
+void setBrightnessLevel(uint16_t level) {
+  DeviceState state = deviceStateBeginUpdate();
+  state.brightnessLevel = level;
+  state.customBrightness = true;
+  publishStateChange(state);
+  Serial.printf("Brightness Level Set - %u\n", level);
 }
 
-void handleStateSwitch() {
-  handleSwitch(pStates, PowerStateEnum::PowerLast, "Power");
+/**
+ * Move the continuous brightness level, e.g. while the brightness switch is held.
+ *
+ * Starts from the current preset step if no continuous level is set, and stops at the ends
+ * of the range.
+ *
+ * @param change The signed change of the perceptual brightness level.
+ */
+void rampBrightnessLevel(int32_t change) {
+  DeviceState state = deviceStateBeginUpdate();
+  int32_t level = state.customBrightness ? state.brightnessLevel : BRIGHTNESS_LEVELS[state.brightness];
+  level += change;
+  state.brightnessLevel = level < 0 ? 0 : level > BRIGHTNESS_LEVEL_MAX ? BRIGHTNESS_LEVEL_MAX : level;
+  state.customBrightness = true;
+  publishStateChange(state);
 }
 
-void handleMotorSwitch() {
-  // Skip handling the motor switch if the device is powered off
-  //if (pStates == PowerStateEnum::PowerOff) return;
-
-  handleSwitch(mStates, MotorStateEnum::MotorLast, "Motor");
+/**
+ * Set the duration of the crossfade between states.
+ *
+ * @param durationMs The crossfade duration in milliseconds; 0 switches instantly.
+ */
+void setFadeDuration(uint16_t durationMs) {
+  DeviceState state = deviceStateBeginUpdate();
+  state.fadeMs = durationMs;
+  publishStateChange(state);
+  Serial.printf("Fade Duration Set - %u\n", durationMs);
 }
 
-void handleBrightnessSwitch() {
-  // Skip handling the motor switch if the device is powered off
-  //if (pStates == PowerStateEnum::PowerOff) return;
+/**
+ * Set several fields of the state as a single state change, so they are published as one
+ * version and broadcast once.
+ *
+ * Setting the brightness step returns to the presets, and setting the brightness level
+ * overrides them, as for the individual commands; if both are set the level wins.
+ *
+ * @param patch The fields to set, already validated.
+ */
+void applyStatePatch(const StatePatch &patch) {
+  DeviceState state = deviceStateBeginUpdate();
+  const DeviceState &values = patch.values;
+
+  if (patch.fields & (1 << PowerField)) state.power = values.power;
+  if (patch.fields & (1 << ColourField)) state.colour = values.colour;
+  if (patch.fields & (1 << MotorField)) state.motor = values.motor;
+  if (patch.fields & (1 << BrightnessField)) {
+    state.brightness = values.brightness;
+    state.customBrightness = false;
+  }
+  if (patch.fields & (1 << BrightnessLevelField)) {
+    state.brightnessLevel = values.brightnessLevel;
+    state.customBrightness = true;
+  }
+  if (patch.fields & (1 << FadeField)) state.fadeMs = values.fadeMs;
 
-  handleSwitch(bStates, BrightnessStateEnum::BrightnessLast, "Brightness");
+  publishStateChange(state);
+  Serial.printf("State Patched - fields 0x%02x\n", patch.fields);
 }
 
-void handleColourSwitch() {
-  // Skip handling the motor switch if the device is powered off
-  //if (pStates == PowerStateEnum::PowerOff) return;
-
-  handleSwitch(rgbwStates, RGBWStateEnum::LedLast, "Colour");
+/**
+ * Step the colour, as the colour switch does.
+ *
+ * @param steps Number of colours to step forward, or backward if negative.
+ */
+void handleColourSwitch(int steps) {
+  handleSwitch(&DeviceState::colour, RGBWStateEnum::LedLast, "Colour", steps);
 }
 
 /**
  * Handle switch state change for an enumerated state.
  *
  * This function is used to handle the change of an enumerated state associated with a switch press.
- * It increments the current state within the provided enumeration range and outputs information
- * about the switch press to the serial monitor.
+ * It steps the state within the provided enumeration range, publishes the new device state
+ * and outputs information about the switch press to the serial monitor.
  *
- * @param enumState A reference to the enumerated state variable to be modified.
+ * @param field The enumerated member of DeviceState to be modified.
  * @param lastEnumValue The last value in the enumeration range, used for wrapping.
  * @param switchName The name of the switch associated with this handler.
+ * @param steps The number of states to step by; negative steps go back.
+ */
+template <typename EnumType>
+void handleSwitch(EnumType DeviceState::*field, EnumType lastEnumValue, const char *switchName, int steps) {
+  DeviceState state = deviceStateBeginUpdate();
+  incrementEnum(state.*field, lastEnumValue, steps);
+  publishStateChange(state);
+
+  Serial.printf("%s Switch Pressed - %d\n", switchName, static_cast<int>(state.*field));
+}
+
+/**
+ * Set an enumerated state to an absolute value.
+ *
+ * @param field The enumerated member of DeviceState to be modified.
+ * @param value The new value; values outside the enumeration range are ignored.
+ * @param lastEnumValue The last value in the enumeration range.
+ * @param stateName The name of the state, for the serial monitor.
  */
 template <typename EnumType>
-void handleSwitch(EnumType &enumState, EnumType lastEnumValue, const char *switchName) {
-  Serial.print(switchName);
-  Serial.print(" Switch Pressed - ");
-  incrementEnum(enumState, lastEnumValue);
-  Serial.println(static_cast<int>(enumState));
+void setEnumState(EnumType DeviceState::*field, uint32_t value, EnumType lastEnumValue, const char *stateName) {
+  if (value >= static_cast<uint32_t>(lastEnumValue)) {
+    Serial.printf("Invalid %s State\n", stateName);
+    return;
+  }
+
+  DeviceState state = deviceStateBeginUpdate();
+  state.*field = static_cast<EnumType>(value);
+  publishStateChange(state);
+
+  Serial.printf("%s Set - %u\n", stateName, value);
+}
+
+/**
+ * Publish a state change started with deviceStateBeginUpdate() and propagate it.
+ *
+ * Commits the new state, wakes the output task and schedules a broadcast of the new state to
+ * the WebSocket clients.
+ *
+ * @param state The modified state.
+ */
+void publishStateChange(const DeviceState &state) {
+  deviceStateCommitUpdate(state);
+
+  // Apply the new state to the outputs
+  notifyOutputTask();
+
+  scheduleBroadcast();
+}
+
+/**
+ * Schedule a broadcast to the WebSocket clients, unless one is already pending.
+ */
+void scheduleBroadcast() {
+  if (broadcastPending) return;
+  broadcastPending = true;
+  broadcastPendingSince = millis();
+}
+
+/**
+ * Hold back an ack until the broadcast of the state its command produced.
+ *
+ * @param id The WebSocket client id.
+ * @param sequence The sequence number of the command.
+ * @param version The state version after the command.
+ */
+void queueAck(uint32_t id, uint16_t sequence, uint32_t version) {
+  // Commands can keep arriving while the owner drains the queues, so make room by
+  // broadcasting early; that state already includes every command applied so far
+  if (pendingAckCount == PENDING_ACKS_MAX) broadcastState();
+  pendingAcks[pendingAckCount++] = {id, sequence, version};
+  scheduleBroadcast();
+}
+
+/**
+ * Broadcast the current state to the WebSocket clients and send the acks held back for it.
+ */
+void broadcastState() {
+  broadcastPending = false;
 
   // Guard against sending WebSocket messages before the connection is established
-  if(!wifiConnected) return; // If WiFi is not connected, WebSocket is not initialised
-  if(!ws.count()) return; // If there are no connected clients, update is not required
-    updateClients();
+  if (wifiConnected && ws.count()) updateClients();
+
+  for (int i = 0; i < pendingAckCount; i++) {
+    sendAck(pendingAcks[i].id, pendingAcks[i].sequence, AppliedAck, pendingAcks[i].version);
+  }
+  pendingAckCount = 0;
 }
 
 
@@ -781,16 +1221,18 @@ void handleSwitch(EnumType &enumState, EnumType lastEnumValue, const char *switc
  * Increments an enumeration value and wraps it around based on the provided range.
  *
  * This function increments the given enumeration value and ensures it wraps around
- * within the range defined by the last enumeration value. The incrementing and wrapping
- * behavior is calculated as (enumValue + 1) % lastEnumValue.
+ * within the range defined by the last enumeration value, in either direction. The
+ * incrementing and wrapping behavior is calculated as (enumValue + steps) mod lastEnumValue.
  *
  * @param enumValue A reference to the enumeration value to be incremented.
  * @param lastEnumValue The last enumeration value in the range, defining the wrapping point.
+ * @param steps The number of values to step by; negative steps go backwards.
  * @return The incremented enumeration value after wrapping.
  */
 template <typename T>
-T incrementEnum(T &enumValue, T lastEnumValue) {
-  enumValue = static_cast<T>((enumValue + 1) % lastEnumValue);
+T incrementEnum(T &enumValue, T lastEnumValue, int steps) {
+  int value = (static_cast<int>(enumValue) + steps % static_cast<int>(lastEnumValue)) % static_cast<int>(lastEnumValue);
+  enumValue = static_cast<T>(value < 0 ? value + lastEnumValue : value);
   return enumValue;
 }
 #pragma endregion
@@ -799,15 +1241,28 @@ T incrementEnum(T &enumValue, T lastEnumValue) {
 void onEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType type,
              void *arg, uint8_t *data, size_t len) {
   switch (type) {
-    case WS_EVT_CONNECT:
-      Serial.printf("WebSocket client #%u connected from %s\n", client->id(), client->remoteIP().toString().c_str());
+    case WS_EVT_CONNECT: {
+      // The argument is the upgrade request: the client gets the binary protocol if it asked
+      // for it, and the JSON protocol otherwise
+      AsyncWebServerRequest *request = (AsyncWebServerRequest *)arg;
+      AsyncWebHeader *protocol = request ? request->getHeader("Sec-WebSocket-Protocol") : nullptr;
+      bool binary = protocol && protocol->value() == WS_BINARY_PROTOCOL;
+
+      if (!wsClientAdd(client->id(), binary)) {
+        Serial.printf("WebSocket client #%u rejected, too many clients\n", client->id());
+        client->close(1013);
+        break;
+      }
+      Serial.printf("WebSocket client #%u connected from %s (%s)\n", client->id(),
+                    client->remoteIP().toString().c_str(), binary ? WS_BINARY_PROTOCOL : "json");
       break;
+    }
     case WS_EVT_DISCONNECT:
+      wsClientRemove(client->id());
       Serial.printf("WebSocket client #%u disconnected\n", client->id());
       break;
     case WS_EVT_DATA:
-      Serial.printf("WebSocket client #%u data received\n", client->id());
-      handleWebSocketMessage(arg, data, len);
+      handleWebSocketMessage(client, arg, data, len);
       break;
     case WS_EVT_PONG:
     case WS_EVT_ERROR:
@@ -815,27 +1270,116 @@ void onEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, AwsEventType
   }
 }
 
-void handleWebSocketMessage(void *arg, uint8_t *payload, size_t length) {
-  String message = "";
-  for (size_t i = 0; i < length; i++) {
-    message += (char)payload[i];
+/**
+ * Handle a message from a WebSocket client.
+ *
+ * Runs in the network task: only parse and queue the command, the state owner does the rest.
+ * Every valid message fits in a single frame, so fragmented messages are rejected.
+ *
+ * @param client The client that sent the message.
+ * @param arg The frame info.
+ * @param payload The frame payload.
+ * @param length The payload length in bytes.
+ */
+void handleWebSocketMessage(AsyncWebSocketClient *client, void *arg, uint8_t *payload, size_t length) {
+  AwsFrameInfo *info = (AwsFrameInfo *)arg;
+  if (!info->final || info->index != 0 || info->len != length) {
+    commandStats[WebSocketSource].invalid++;
+    return;
+  }
+
+  if (info->opcode == WS_BINARY) {
+    handleBinaryMessage(client, payload, length);
+  } else {
+    handleTextMessage(client, payload, length);
+  }
+}
+
+/**
+ * Handle a message in the text protocol, e.g. "Colour" or "Brightness:42".
+ */
+void handleTextMessage(AsyncWebSocketClient *client, uint8_t *payload, size_t length) {
+  CommandTypeEnum command;
+  uint32_t value;
+  if (!wsTextDecodeRequest(payload, length, command, value)) {
+    commandStats[WebSocketSource].invalid++;
+    return;
   }
 
-  Serial.println(message);
+  // getStates answers the client that asked
+  if (command == GetStatesCommand) value = client->id();
+  commandSubmit(command, WebSocketSource, value);
+}
 
-  if (message == "Power") {
-    handleStateSwitch();
-  } else if (message == "Brightness") {
-    handleBrightnessSwitch();
-  } else if (message == "Colour") {
-    handleColourSwitch();
-  } else if (message == "Motor") {
-    handleMotorSwitch();
-  } else if (message == "getStates") {
-    updateClients();
+/**
+ * Handle a frame in the binary protocol (see ws_protocol.h).
+ */
+void handleBinaryMessage(AsyncWebSocketClient *client, uint8_t *payload, size_t length) {
+  BinaryRequest request;
+  if (!wsBinaryDecodeRequest(payload, length, request)) {
+    commandStats[WebSocketSource].invalid++;
+    if (request.sequenced) sendAck(client->id(), request.sequence, InvalidAck, deviceStateVersion());
+    return;
+  }
+
+  if (request.sequenced) {
+    submitSequencedCommand(client, request);
+  } else if (request.operation == SubscribeOperation) {
+    // Send the newly subscribed fields straight away
+    wsClientSubscribe(client->id(), request.value);
+    commandSubmit(GetStatesCommand, WebSocketSource, client->id());
+  } else if (request.operation == HelloOperation) {
+    wsClientIdentify(client->id(), request.value);
   } else {
-    Serial.println("Invalid WebSocket message");
+    commandSubmit(request.command, WebSocketSource, request.value);
+  }
+}
+
+/**
+ * Submit a sequenced command, unless the client has sent it before.
+ *
+ * Commands are deduplicated by the id the client identified itself with, so a command
+ * resent on a new connection is recognised too. A duplicate is acked straight away with the
+ * current version; a new command is acked by the state owner once applied.
+ *
+ * @param client The client that sent the command.
+ * @param request The decoded command.
+ */
+void submitSequencedCommand(AsyncWebSocketClient *client, const BinaryRequest &request) {
+  uint32_t clientId = wsClientIdentity(client->id());
+  if (!clientId) {
+    commandStats[WebSocketSource].invalid++;
+    sendAck(client->id(), request.sequence, InvalidAck, deviceStateVersion());
+    return;
   }
+
+  if (dedupeCheck(clientId, request.sequence) != DedupeNew) {
+    sendAck(client->id(), request.sequence, DuplicateAck, deviceStateVersion());
+    return;
+  }
+
+  if (!commandSubmit(request.command, WebSocketSource, request.value, client->id(), request.sequence)) {
+    // Not queued, so a retry must not be mistaken for a duplicate
+    dedupeForget(clientId, request.sequence);
+    sendAck(client->id(), request.sequence, BusyAck, deviceStateVersion());
+  }
+}
+
+/**
+ * Send an ack for a sequenced command.
+ *
+ * @param id The WebSocket client id.
+ * @param sequence The sequence number of the command.
+ * @param status The outcome of the command.
+ * @param version The state version after the command.
+ */
+void sendAck(uint32_t id, uint16_t sequence, AckStatusEnum status, uint32_t version) {
+  AsyncWebSocketClient *client = ws.client(id);
+  if (!client) return;
+
+  uint8_t frame[WS_BINARY_ACK_FRAME];
+  size_t length = wsBinaryEncodeAck(sequence, status, version, frame);
+  client->message(new WsReplyMessage(id, frame, length, true));
 }
 
 void initWebSocket() {
@@ -843,28 +1387,465 @@ void initWebSocket() {
   server.addHandler(&ws);
 }
 
-String generateJsonForStates() {
-  // Create a JSON object containing the current states
-  JSONVar states;
+/**
+ * Write the state document sent to JSON clients, e.g. {"Power":1,"Brightness":0,...}. The
+ * continuous brightness level is only included while it overrides the brightness step.
+ *
+ * @param state The state to write.
+ * @param buffer The buffer to write into, JSON_STATE_SIZE bytes is always enough.
+ * @param size The size of the buffer.
+ * @return The length of the document, or 0 if it did not fit.
+ */
+size_t generateJsonForStates(const DeviceState &state, char *buffer, size_t size) {
+  JsonWriter json;
+  jsonWriterBegin(json, buffer, size);
+
+  jsonBeginObject(json);
+  jsonKey(json, "Power");
+  jsonUint(json, state.power);
+  jsonKey(json, "Brightness");
+  jsonUint(json, state.brightness);
+  jsonKey(json, "Colour");
+  jsonUint(json, state.colour);
+  jsonKey(json, "Motor");
+  jsonUint(json, state.motor);
+  if (state.customBrightness) {
+    jsonKey(json, "BrightnessLevel");
+    jsonUint(json, state.brightnessLevel * 100UL / BRIGHTNESS_LEVEL_MAX);
+  }
+  jsonEndObject(json);
+
+  return jsonWriterEnd(json);
+}
+
+/**
+ * Parse a state document in the format written by generateJsonForStates(), plus an optional
+ * "Fade" duration in milliseconds. Members may be left out.
+ *
+ * @param data The document.
+ * @param length The length of the document.
+ * @param state Receives the members present in the document.
+ * @param fields Receives the members present, as a StateFieldEnum mask.
+ * @return Whether the document was a valid state, with every member in range.
+ */
+bool parseJsonForStates(const char *data, size_t length, DeviceState &state, uint8_t &fields) {
+  JsonTokenizer json;
+  jsonTokenizerBegin(json, data, length);
+  fields = 0;
+
+  JsonToken token;
+  if (!jsonNextToken(json, token) || token.type != JsonObjectStartToken) return false;
+  if (!jsonNextToken(json, token)) return false;
+
+  // Each member is a key, one colon and a value
+  while (token.type != JsonObjectEndToken) {
+    JsonToken key = token, value;
+    if (!jsonNextToken(json, token) || token.type != JsonColonToken) return false;
+    if (!jsonNextToken(json, value) || value.type != JsonNumberToken || value.number < 0) return false;
+    uint32_t number = value.number;
+
+    if (jsonTokenEquals(key, "Power") && number < PowerStateEnum::PowerLast) {
+      state.power = static_cast<PowerStateEnum>(number);
+      fields |= 1 << PowerField;
+    } else if (jsonTokenEquals(key, "Brightness") && number < BrightnessStateEnum::BrightnessLast) {
+      state.brightness = static_cast<BrightnessStateEnum>(number);
+      fields |= 1 << BrightnessField;
+    } else if (jsonTokenEquals(key, "Colour") && number < RGBWStateEnum::LedLast) {
+      state.colour = static_cast<RGBWStateEnum>(number);
+      fields |= 1 << ColourField;
+    } else if (jsonTokenEquals(key, "Motor") && number < MotorStateEnum::MotorLast) {
+      state.motor = static_cast<MotorStateEnum>(number);
+      fields |= 1 << MotorField;
+    } else if (jsonTokenEquals(key, "BrightnessLevel") && number <= 100) {
+      state.brightnessLevel = brightnessLevelFromPercent(number);
+      fields |= 1 << BrightnessLevelField;
+    } else if (jsonTokenEquals(key, "Fade") && number <= UINT16_MAX) {
+      state.fadeMs = number;
+      fields |= 1 << FadeField;
+    } else {
+      return false;
+    }
+
+    // One comma must lead to the next member, anything else must close the object
+    if (!jsonNextToken(json, token)) return false;
+    if (token.type == JsonCommaToken) {
+      if (!jsonNextToken(json, token) || token.type != JsonStringToken) return false;
+    } else if (token.type != JsonObjectEndToken) {
+      return false;
+    }
+  }
+
+  // Nothing may follow the object
+  return !jsonNextToken(json, token) && token.type == JsonEndToken;
+}
+
+/**
+ * Report the render cost of every effect, so effects that do not fit in the frame budget
+ * can be spotted. The budget is the number of CPU cycles in one frame at the current
+ * render rate; the costs are CPU cycles per rendered frame. Also reports the output task's
+ * renders, total busy time and the time from a state change to the outputs.
+ */
+size_t generateJsonForEffects(char *buffer, size_t size) {
+  JsonWriter json;
+  jsonWriterBegin(json, buffer, size);
+
+  jsonBeginObject(json);
+  jsonKey(json, "budgetCycles");
+  jsonUint(json, getCpuFrequencyMhz() * 1000000UL / renderStats.rateHz);
+
+  jsonKey(json, "effects");
+  jsonBeginObject(json);
+  for (int i = 0; i < RGBWStateEnum::LedLast; i++) {
+    const EffectStats &stats = effectStats[i];
+    jsonKey(json, EFFECTS[i].name);
+    jsonBeginObject(json);
+    jsonKey(json, "animated");
+    jsonBool(json, EFFECTS[i].kind->animated);
+    jsonKey(json, "renders");
+    jsonUint(json, stats.renders);
+    jsonKey(json, "minCycles");
+    jsonUint(json, stats.minCycles);
+    jsonKey(json, "avgCycles");
+    jsonUint(json, stats.renders ? stats.totalCycles / stats.renders : 0);
+    jsonKey(json, "maxCycles");
+    jsonUint(json, stats.maxCycles);
+    jsonEndObject(json);
+  }
+  jsonEndObject(json);
+
+  jsonKey(json, "output");
+  jsonBeginObject(json);
+  jsonKey(json, "renders");
+  jsonUint(json, outputStats.renders);
+  jsonKey(json, "busyUs");
+  jsonUint(json, outputStats.busyTime);
+  jsonKey(json, "lastLatencyUs");
+  jsonUint(json, outputStats.lastLatency);
+  jsonKey(json, "maxLatencyUs");
+  jsonUint(json, outputStats.maxLatency);
+  jsonEndObject(json);
+  jsonEndObject(json);
+
+  return jsonWriterEnd(json);
+}
+
+/**
+ * Report the command statistics of every input source: how many commands were submitted,
+ * dropped because the queue was full, rejected as invalid and applied, and the time from
+ * submission to application.
+ */
+size_t generateJsonForCommands(char *buffer, size_t size) {
+  JsonWriter json;
+  jsonWriterBegin(json, buffer, size);
+
+  jsonBeginObject(json);
+  for (int i = 0; i < CommandSourceLast; i++) {
+    const CommandStats &stats = commandStats[i];
+    jsonKey(json, COMMAND_SOURCE_NAMES[i]);
+    jsonBeginObject(json);
+    jsonKey(json, "submitted");
+    jsonUint(json, stats.submitted);
+    jsonKey(json, "dropped");
+    jsonUint(json, stats.dropped);
+    jsonKey(json, "invalid");
+    jsonUint(json, stats.invalid);
+    jsonKey(json, "applied");
+    jsonUint(json, stats.applied);
+    jsonKey(json, "avgLatencyUs");
+    jsonUint(json, stats.applied ? stats.latencyTotal / stats.applied : 0);
+    jsonKey(json, "maxLatencyUs");
+    jsonUint(json, stats.latencyMax);
+    jsonEndObject(json);
+  }
+  jsonEndObject(json);
+
+  return jsonWriterEnd(json);
+}
+
+/**
+ * Report the WebSocket broadcast statistics: how many broadcasts were sent and how many
+ * state versions were coalesced into them, the messages, payloads and bytes they queued, and
+ * the buffer allocations they needed. Besides the pooled buffers, the web server allocates a
+ * message for each queued message; a private copy also allocates its own buffer.
+ */
+size_t generateJsonForBroadcasts(char *buffer, size_t size) {
+  const BroadcastStats &stats = broadcastStats;
+  unsigned long broadcasts = stats.broadcasts ? stats.broadcasts : 1;
+
+  JsonWriter json;
+  jsonWriterBegin(json, buffer, size);
+
+  jsonBeginObject(json);
+  jsonKey(json, "broadcasts");
+  jsonUint(json, stats.broadcasts);
+  jsonKey(json, "coalesced");
+  jsonUint(json, stats.coalesced);
+  jsonKey(json, "messages");
+  jsonUint(json, stats.messages);
+  jsonKey(json, "payloads");
+  jsonUint(json, stats.payloads);
+  jsonKey(json, "deferred");
+  jsonUint(json, stats.deferred);
+  jsonKey(json, "bytes");
+  jsonUint(json, stats.bytes);
+  jsonKey(json, "avgBytes");
+  jsonUint(json, stats.bytes / broadcasts);
+  jsonKey(json, "avgMessages");
+  jsonUint(json, stats.messages / broadcasts);
+  jsonKey(json, "buffers");
+  jsonBeginObject(json);
+  jsonKey(json, "pool");
+  jsonUint(json, WS_BROADCAST_BUFFERS);
+  jsonKey(json, "acquired");
+  jsonUint(json, wsBufferStats.acquired);
+  jsonKey(json, "allocations");
+  jsonUint(json, wsBufferStats.allocations);
+  jsonKey(json, "exhausted");
+  jsonUint(json, wsBufferStats.exhausted);
+  jsonEndObject(json);
+  jsonEndObject(json);
+
+  return jsonWriterEnd(json);
+}
+
+/**
+ * Report the outgoing queue of every connected WebSocket client: how many messages are queued
+ * and not yet sent, whether its state slot is taken, and how many messages were queued,
+ * states replaced by a newer one while waiting for the slot, and messages dropped unsent.
+ */
+size_t generateJsonForClients(char *buffer, size_t size) {
+  JsonWriter json;
+  jsonWriterBegin(json, buffer, size);
+
+  jsonBeginArray(json);
+  for (int slot = 0; slot < WS_MAX_CLIENTS; slot++) {
+    WsClientStats stats;
+    if (!wsClientStats(slot, stats)) continue;
+    jsonBeginObject(json);
+    jsonKey(json, "id");
+    jsonUint(json, stats.id);
+    jsonKey(json, "depth");
+    jsonUint(json, stats.depth);
+    jsonKey(json, "maxDepth");
+    jsonUint(json, stats.maxDepth);
+    jsonKey(json, "stateQueued");
+    jsonBool(json, stats.stateQueued);
+    jsonKey(json, "queued");
+    jsonUint(json, stats.queued);
+    jsonKey(json, "replaced");
+    jsonUint(json, stats.replaced);
+    jsonKey(json, "dropped");
+    jsonUint(json, stats.dropped);
+    jsonEndObject(json);
+  }
+  jsonEndArray(json);
+
+  return jsonWriterEnd(json);
+}
+
+/**
+ * Respond to a request with a JSON report.
+ *
+ * @param request The request.
+ * @param generate The function writing the report into a JSON_REPORT_SIZE buffer.
+ */
+void sendJsonReport(AsyncWebServerRequest *request, size_t (*generate)(char *buffer, size_t size)) {
+  char json[JSON_REPORT_SIZE];
+  if (generate(json, sizeof(json))) {
+    request->send(200, "application/json", json);
+  } else {
+    request->send(500);
+  }
+}
+
+/**
+ * Format the ETag of a state version, e.g. "1a2b3c4d-42".
+ *
+ * @param version The state version.
+ * @param buffer The buffer to write into, at least 24 bytes.
+ */
+void formatStateETag(uint32_t version, char *buffer) {
+  sprintf(buffer, "\"%08x-%u\"", (unsigned)bootId, (unsigned)version);
+}
+
+/**
+ * GET /api/state: respond with the state document, tagged with an ETag derived from the
+ * state version. A request whose If-None-Match already holds the current ETag gets an empty
+ * 304, so polling an unchanged state costs a version read.
+ *
+ * @param request The request.
+ */
+void handleGetState(AsyncWebServerRequest *request) {
+  DeviceState state;
+  uint32_t version = deviceStateRead(state);
+
+  char etag[24];
+  formatStateETag(version, etag);
+
+  AsyncWebHeader *ifNoneMatch = request->getHeader("If-None-Match");
+  if (ifNoneMatch && (ifNoneMatch->value() == "*" || ifNoneMatch->value().indexOf(etag) >= 0)) {
+    AsyncWebServerResponse *response = request->beginResponse(304);
+    response->addHeader("ETag", etag);
+    request->send(response);
+    return;
+  }
+
+  char json[JSON_STATE_SIZE];
+  generateJsonForStates(state, json, sizeof(json));
+
+  AsyncWebServerResponse *response = request->beginResponse(200, "application/json", json);
+  response->addHeader("ETag", etag);
+  response->addHeader("Cache-Control", "no-cache");
+  request->send(response);
+}
+
+/**
+ * Check that a state API request's body is JSON, or untyped.
+ *
+ * The web server only hands such bodies to the body handler: form and multipart bodies, and
+ * text/plain ones that look like a form, are parsed into parameters instead.
+ *
+ * @param request The request.
+ * @return Whether the body is application/json or has no content type.
+ */
+bool hasJsonBody(AsyncWebServerRequest *request) {
+  const String &contentType = request->contentType();
+  return !contentType.length() || contentType.equalsIgnoreCase("application/json");
+}
+
+/**
+ * Body handler for PUT and PATCH /api/state.
+ *
+ * The body is a state document as returned by GET, plus an optional "Fade" in milliseconds.
+ * PATCH sets the members present; PUT replaces the state, so Power, Brightness, Colour and
+ * Motor are required, and the brightness returns to its step unless BrightnessLevel is
+ * given. The update is queued as one patch for the state owner, which applies it as a single
+ * state version and broadcasts it once, so the response is 202 Accepted. Bodies longer than
+ * STATE_BODY_MAX are refused with 413, and bodies that are not JSON with 415.
+ *
+ * @param request The request.
+ * @param data This chunk of the body.
+ * @param len The length of this chunk.
+ * @param index The offset of this chunk in the body.
+ * @param total The length of the whole body.
+ */
+void handleSetState(AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+  // Refused by the request handler, which runs for every request
+  if (!hasJsonBody(request)) return;
+
+  if (total > STATE_BODY_MAX) {
+    if (index + len == total) request->send(413, "text/plain", "State too large");
+    return;
+  }
 
-  // Add the states to the JSON object
-  states["Power"] = static_cast<int>(pStates);
-  states["Brightness"] = static_cast<int>(bStates);
-  states["Colour"] = static_cast<int>(rgbwStates);
-  states["Motor"] = static_cast<int>(mStates);
+  // A body that arrives in several chunks is collected in a buffer of its full length, which
+  // the request frees when it ends; a body in one chunk is parsed where it is
+  const char *body = (const char *)data;
+  if (len != total) {
+    if (index == 0) request->_tempObject = malloc(total);
+    if (!request->_tempObject) {
+      if (index + len == total) request->send(503, "text/plain", "Busy");
+      return;
+    }
+    memcpy((uint8_t *)request->_tempObject + index, data, len);
+    if (index + len != total) return;
+    body = (const char *)request->_tempObject;
+  }
 
-  // Convert the JSON object to a string
-  String json = JSON.stringify(states);
+  StatePatch patch = {};
+  if (!parseJsonForStates(body, total, patch.values, patch.fields)) {
+    commandStats[RestSource].invalid++;
+    request->send(400, "text/plain", "Invalid state");
+    return;
+  }
 
-  // Return the JSON string
-  return json;
+  if (request->method() == HTTP_PUT) {
+    const uint8_t required = 1 << PowerField | 1 << BrightnessField | 1 << ColourField | 1 << MotorField;
+    if ((patch.fields & required) != required) {
+      commandStats[RestSource].invalid++;
+      request->send(400, "text/plain", "Incomplete state");
+      return;
+    }
+  }
+
+  if (!commandSubmitPatch(patch, RestSource)) {
+    request->send(503, "text/plain", "Busy");
+    return;
+  }
+  request->send(202);
 }
 
+/**
+ * Bring every connected WebSocket client up to date with the current state.
+ *
+ * Each client is only sent what it has not seen yet: binary clients get a delta of their
+ * subscribed fields tagged with the state version, JSON clients get the whole state document.
+ * Clients that are already up to date are sent nothing.
+ *
+ * Each distinct payload is serialized once into a pooled buffer that is queued to every
+ * client it is meant for; usually that is one JSON document and one binary delta. A client
+ * whose last state message has not been sent yet is skipped, and gets the newest state once
+ * it has. If every pooled buffer is still queued to slow clients, the update is put off to
+ * the next broadcast.
+ */
 void updateClients() {
-  // Generate a JSON string containing the current states
-  String json = generateJsonForStates();
+  DeviceState state;
+  uint32_t version = deviceStateRead(state);
+
+  // Payloads of this broadcast: the JSON document, and a binary delta per field mask
+  struct SharedPayload {
+    bool binary;
+    uint8_t fields;
+    AsyncWebSocketMessageBuffer *buffer;
+  };
+  SharedPayload payloads[WS_MAX_CLIENTS];
+  int payloadCount = 0;
+  unsigned long messages = broadcastStats.messages;
+
+  for (int slot = 0; slot < WS_MAX_CLIENTS; slot++) {
+    WsClientUpdate update;
+    if (!wsClientTakeUpdate(slot, state, update)) continue;
+    AsyncWebSocketClient *client = ws.client(update.id);
+    if (!client) continue;
+
+    // The JSON document is the same for every text client
+    uint8_t fields = update.binary ? update.fields : 0;
+    SharedPayload *payload = nullptr;
+    for (int i = 0; i < payloadCount; i++) {
+      if (payloads[i].binary == update.binary && payloads[i].fields == fields) payload = &payloads[i];
+    }
 
-  // Send the JSON string to all connected clients
-  ws.textAll(json);
+    if (!payload) {
+      char data[JSON_STATE_SIZE];
+      size_t length = update.binary ? wsBinaryEncodeState(state, version, fields, (uint8_t *)data)
+                                    : generateJsonForStates(state, data, sizeof(data));
+      AsyncWebSocketMessageBuffer *buffer = wsBufferAcquire(length);
+
+      if (!buffer) {
+        // Every buffer is still queued to slow clients; try again with the next broadcast
+        wsClientResync(update.id);
+        broadcastStats.deferred++;
+        scheduleBroadcast();
+        continue;
+      }
+
+      broadcastStats.payloads++;
+      memcpy(buffer->get(), data, length);
+      payload = &payloads[payloadCount++];
+      *payload = {update.binary, fields, buffer};
+    }
+
+    client->message(new WsStateMessage(update.id, payload->buffer, update.binary));
+    broadcastStats.messages++;
+    broadcastStats.bytes += payload->buffer->length();
+  }
+
+  for (int i = 0; i < payloadCount; i++) wsBufferRelease(payloads[i].buffer);
+
+  if (broadcastStats.messages != messages) {
+    broadcastStats.broadcasts++;
+    if (version - broadcastVersion > 1) broadcastStats.coalesced += version - broadcastVersion - 1;
+  }
+  broadcastVersion = version;
 }
 #pragma endregion
\ No newline at end of file
@@ -0,0 +1,99 @@
+#include "output_driver.h"
+
+#include <driver/ledc.h>
+
+// Channels 0-5 of the high speed LEDC group, all driven by timer 0
+#define OUTPUT_LEDC_MODE LEDC_HIGH_SPEED_MODE
+#define OUTPUT_LEDC_TIMER LEDC_TIMER_0
+
+// Duty value that keeps the output high for the whole period
+#define OUTPUT_DUTY_FULL (1UL << OUTPUT_PWM_RESOLUTION)
+
+// Number of low level bits below one PWM step, and their mask
+#define OUTPUT_DITHER_BITS (16 - OUTPUT_PWM_RESOLUTION)
+#define OUTPUT_DITHER_MASK ((1UL << OUTPUT_DITHER_BITS) - 1)
+
+// Duty values of the last committed frame, to skip unchanged channels
+static uint32_t committedDuty[ChannelLast];
+
+// Quantisation error carried into the next frame by the sigma-delta dither
+static uint32_t ditherError[ChannelLast];
+
+// Keeps the latch sequence from being split by preemption or the other core
+static portMUX_TYPE commitMux = portMUX_INITIALIZER_UNLOCKED;
+
+/**
+ * Scale a 16-bit output level to the configured PWM resolution, rounding to the nearest step.
+ */
+static inline uint32_t levelToDuty(uint16_t level) {
+  return level == OUTPUT_LEVEL_MAX ? OUTPUT_DUTY_FULL : (level + (OUTPUT_DITHER_MASK + 1) / 2) >> OUTPUT_DITHER_BITS;
+}
+
+/**
+ * Scale a 16-bit output level to the configured PWM resolution with sigma-delta dithering.
+ *
+ * @param level The output level.
+ * @param error The channel's carried quantisation error, updated for the next frame.
+ */
+static inline uint32_t levelToDitheredDuty(uint16_t level, uint32_t &error) {
+  if (level == OUTPUT_LEVEL_MAX) {
+    error = 0;
+    return OUTPUT_DUTY_FULL;
+  }
+
+  // The sum never exceeds full scale, so the duty stays within 0..OUTPUT_DUTY_FULL
+  uint32_t sum = level + error;
+  error = sum & OUTPUT_DITHER_MASK;
+  return sum >> OUTPUT_DITHER_BITS;
+}
+
+void outputBegin(const uint8_t (&pins)[ChannelLast]) {
+  ledc_timer_config_t timer = {};
+  timer.speed_mode = OUTPUT_LEDC_MODE;
+  timer.duty_resolution = static_cast<ledc_timer_bit_t>(OUTPUT_PWM_RESOLUTION);
+  timer.timer_num = OUTPUT_LEDC_TIMER;
+  timer.freq_hz = OUTPUT_PWM_FREQUENCY;
+  timer.clk_cfg = LEDC_AUTO_CLK;
+  if (ledc_timer_config(&timer) != ESP_OK) {
+    Serial.println("Failed to configure LEDC timer");
+    return;
+  }
+
+  for (int i = 0; i < ChannelLast; i++) {
+    ledc_channel_config_t channel = {};
+    channel.gpio_num = pins[i];
+    channel.speed_mode = OUTPUT_LEDC_MODE;
+    channel.channel = static_cast<ledc_channel_t>(i);
+    channel.intr_type = LEDC_INTR_DISABLE;
+    channel.timer_sel = OUTPUT_LEDC_TIMER;
+    channel.duty = 0;
+    channel.hpoint = 0;
+    if (ledc_channel_config(&channel) != ESP_OK) {
+      Serial.printf("Failed to configure LEDC channel for pin %u\n", pins[i]);
+    }
+    committedDuty[i] = 0;
+    ditherError[i] = 0;
+  }
+}
+
+void outputCommit(const OutputFrame &frame, bool dither) {
+  uint32_t changed = 0;
+
+  // Stage the new duty values; they take no effect until latched
+  for (int i = 0; i < ChannelLast; i++) {
+    uint32_t duty = dither ? levelToDitheredDuty(frame.levels[i], ditherError[i]) : levelToDuty(frame.levels[i]);
+    if (duty == committedDuty[i]) continue;
+
+    ledc_set_duty(OUTPUT_LEDC_MODE, static_cast<ledc_channel_t>(i), duty);
+    committedDuty[i] = duty;
+    changed |= 1 << i;
+  }
+  if (!changed) return;
+
+  // Latch every staged channel back to back so they all switch on the same PWM period
+  portENTER_CRITICAL(&commitMux);
+  for (int i = 0; i < ChannelLast; i++) {
+    if (changed & (1 << i)) ledc_update_duty(OUTPUT_LEDC_MODE, static_cast<ledc_channel_t>(i));
+  }
+  portEXIT_CRITICAL(&commitMux);
+}
@@ -0,0 +1,83 @@
+#include "render_scheduler.h"
+
+RenderStats renderStats = {RENDER_RATE_HZ, 0, 0, 0, 0, 0, 0};
+
+// Frame period in ticks and microseconds for the configured rate
+static TickType_t periodTicks = (configTICK_RATE_HZ + RENDER_RATE_HZ / 2) / RENDER_RATE_HZ;
+static uint32_t periodMicros = periodTicks * portTICK_PERIOD_MS * 1000;
+
+// Scheduler state, only touched by the output task
+static bool animating = false;
+static TickType_t lastWakeTick = 0;
+static uint32_t lastWakeMicros = 0;
+static uint32_t frameStartMicros = 0;
+
+void renderSchedulerSetRate(uint32_t rateHz) {
+  if (rateHz < RENDER_RATE_MIN_HZ) rateHz = RENDER_RATE_MIN_HZ;
+  if (rateHz > RENDER_RATE_MAX_HZ) rateHz = RENDER_RATE_MAX_HZ;
+
+  periodTicks = (configTICK_RATE_HZ + rateHz / 2) / rateHz;
+  periodMicros = periodTicks * portTICK_PERIOD_MS * 1000;
+  renderStats.rateHz = rateHz;
+}
+
+void renderSchedulerBeginFrame() {
+  frameStartMicros = micros();
+}
+
+/**
+ * Print a summary of the animation run that just ended to the serial monitor.
+ */
+static void reportAnimationStats() {
+  uint32_t intervals = renderStats.frames > 1 ? renderStats.frames - 1 : 1;
+  Serial.printf("Animation stopped: %u frames at %u Hz, %u missed deadlines, "
+                "jitter avg %u us max %u us, frame time avg %u us max %u us\n",
+                renderStats.frames, renderStats.rateHz, renderStats.missedDeadlines,
+                (uint32_t)(renderStats.jitterTotal / intervals), renderStats.jitterMax,
+                (uint32_t)(renderStats.frameTimeTotal / (renderStats.frames ? renderStats.frames : 1)),
+                renderStats.frameTimeMax);
+}
+
+void renderSchedulerWait(bool animated) {
+  uint32_t frameTime = micros() - frameStartMicros;
+
+  if (!animated) {
+    if (animating) {
+      animating = false;
+      reportAnimationStats();
+    }
+
+    // Nothing changes until the state does, so sleep until notified
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    return;
+  }
+
+  if (!animating) {
+    // Start a new animation run, counting from the frame just rendered
+    animating = true;
+    renderStats = {renderStats.rateHz, 0, 0, 0, 0, 0, 0};
+    lastWakeTick = xTaskGetTickCount();
+    lastWakeMicros = 0;
+  }
+
+  renderStats.frameTimeTotal += frameTime;
+  if (frameTime > renderStats.frameTimeMax) renderStats.frameTimeMax = frameTime;
+
+  // The frame overran if the next one is already due
+  if ((TickType_t)(xTaskGetTickCount() - lastWakeTick) >= periodTicks) renderStats.missedDeadlines++;
+
+  vTaskDelayUntil(&lastWakeTick, periodTicks);
+
+  // Any state change made before this point is picked up by the frame about to be rendered
+  ulTaskNotifyTake(pdTRUE, 0);
+
+  uint32_t wakeMicros = micros();
+  if (lastWakeMicros) {
+    uint32_t interval = wakeMicros - lastWakeMicros;
+    uint32_t jitter = interval > periodMicros ? interval - periodMicros : periodMicros - interval;
+    renderStats.jitterTotal += jitter;
+    if (jitter > renderStats.jitterMax) renderStats.jitterMax = jitter;
+  }
+  lastWakeMicros = wakeMicros;
+  renderStats.frames++;
+}
@@ -0,0 +1,157 @@
+#include "switch_input.h"
+
+#include <esp_timer.h>
+#include <freertos/queue.h>
+#include <soc/gpio_reg.h>
+
+// Debounce state of one switch
+enum SwitchStateEnum {
+  SwitchReleased,  // Idle
+  SwitchPressed,   // Press reported, waiting for a release edge
+  SwitchReleasing  // Release edge seen, waiting out the bounce before reporting it
+};
+
+// What the input task is told about a switch
+enum SwitchSignalEnum {
+  PressedEdge,    // Pin went low
+  ReleasedEdge,   // Pin went high
+  DebounceExpired // The switch's debounce timer ran out
+};
+
+struct SwitchSignal {
+  uint8_t button;
+  uint8_t signal;
+  int64_t timeMicros; // esp_timer time, which millis() is derived from
+};
+
+struct SwitchInput {
+  uint8_t pin;
+  SwitchStateEnum state;
+  int64_t releasedAt;              // Time of the release edge being debounced (us)
+  esp_timer_handle_t debounceTimer;
+};
+
+static SwitchInput switches[SwitchLast];
+static QueueHandle_t signalQueue = nullptr;
+
+/**
+ * Sample every switch at once from the GPIO input registers.
+ *
+ * The switches are on GPIO25/26 and GPIO32/33, which straddle the two input registers
+ * (GPIO0-31 and GPIO32-39), so this is one read of each rather than a digitalRead() per pin.
+ *
+ * @return A bitmask of the switches that are pressed (pin low), indexed by SwitchEnum.
+ */
+static uint32_t IRAM_ATTR sampleSwitches() {
+  uint64_t levels = REG_READ(GPIO_IN_REG) | ((uint64_t)(REG_READ(GPIO_IN1_REG) & 0xFF) << 32);
+
+  uint32_t pressed = 0;
+  for (int i = 0; i < SwitchLast; i++) {
+    if (!((levels >> switches[i].pin) & 1)) pressed |= 1UL << i;
+  }
+  return pressed;
+}
+
+/**
+ * GPIO interrupt for a switch pin: timestamp the edge and hand it to the input task.
+ */
+static void IRAM_ATTR switchEdgeISR(void *arg) {
+  uint8_t button = (uint8_t)(uintptr_t)arg;
+  bool pressed = (sampleSwitches() >> button) & 1;
+  SwitchSignal signal = {button, (uint8_t)(pressed ? PressedEdge : ReleasedEdge), esp_timer_get_time()};
+
+  BaseType_t higherPriorityTaskWoken = pdFALSE;
+  xQueueSendFromISR(signalQueue, &signal, &higherPriorityTaskWoken);
+  if (higherPriorityTaskWoken) portYIELD_FROM_ISR();
+}
+
+/**
+ * Convert an esp_timer time to the millis() clock, which is the same time in milliseconds
+ * truncated to 32 bits. Truncating the microseconds first instead would wrap after 71 minutes
+ * and put the result on a different clock.
+ */
+static uint32_t toMillis(int64_t timeMicros) {
+  return (uint32_t)(timeMicros / 1000);
+}
+
+/**
+ * Debounce timer callback, run on the esp_timer task.
+ */
+static void switchDebounceExpired(void *arg) {
+  SwitchSignal signal = {(uint8_t)(uintptr_t)arg, DebounceExpired, esp_timer_get_time()};
+  xQueueSend(signalQueue, &signal, 0);
+}
+
+void switchInputBegin(const uint8_t (&pins)[SwitchLast]) {
+  signalQueue = xQueueCreate(SWITCH_EVENT_QUEUE_SIZE, sizeof(SwitchSignal));
+
+  for (int i = 0; i < SwitchLast; i++) {
+    SwitchInput &input = switches[i];
+    input.pin = pins[i];
+    input.state = SwitchReleased;
+
+    esp_timer_create_args_t timerArgs = {};
+    timerArgs.callback = switchDebounceExpired;
+    timerArgs.arg = (void *)(uintptr_t)i;
+    timerArgs.name = "switch_debounce";
+    esp_timer_create(&timerArgs, &input.debounceTimer);
+
+    // Switches are active low so use INPUT_PULLUP
+    pinMode(input.pin, INPUT_PULLUP);
+    attachInterruptArg(input.pin, switchEdgeISR, (void *)(uintptr_t)i, CHANGE);
+  }
+}
+
+bool switchInputReceive(SwitchEvent &event, TickType_t ticksToWait) {
+  TickType_t start = xTaskGetTickCount();
+
+  for (;;) {
+    // Signals that do not complete a transition (bounce) must not extend the wait
+    TickType_t remaining = ticksToWait;
+    if (ticksToWait != portMAX_DELAY) {
+      TickType_t elapsed = xTaskGetTickCount() - start;
+      remaining = elapsed < ticksToWait ? ticksToWait - elapsed : 0;
+    }
+
+    SwitchSignal signal;
+    if (xQueueReceive(signalQueue, &signal, remaining) != pdPASS) return false;
+    SwitchInput &input = switches[signal.button];
+
+    switch (signal.signal) {
+      case PressedEdge:
+        if (input.state == SwitchReleased) {
+          // No debounce is needed on the press: the state change itself ignores the bounce
+          input.state = SwitchPressed;
+          event = {static_cast<SwitchEnum>(signal.button), true, toMillis(signal.timeMicros)};
+          return true;
+        }
+        if (input.state == SwitchReleasing) {
+          // Bounce after a release edge: the switch is still held
+          esp_timer_stop(input.debounceTimer);
+          input.state = SwitchPressed;
+        }
+        break;
+
+      case ReleasedEdge:
+        if (input.state == SwitchPressed) {
+          input.state = SwitchReleasing;
+          input.releasedAt = signal.timeMicros;
+          esp_timer_start_once(input.debounceTimer, SWITCH_DEBOUNCE_MS * 1000ULL);
+        }
+        break;
+
+      case DebounceExpired:
+        // Ignore a stale expiry from a timer that was stopped after it had already fired. The
+        // difference is signed, so an expiry queued before this release edge is stale too.
+        if (input.state != SwitchReleasing) break;
+        if (signal.timeMicros - input.releasedAt < (int64_t)SWITCH_DEBOUNCE_MS * 1000) break;
+        if ((sampleSwitches() >> signal.button) & 1) {
+          input.state = SwitchPressed;
+          break;
+        }
+        input.state = SwitchReleased;
+        event = {static_cast<SwitchEnum>(signal.button), false, toMillis(input.releasedAt)};
+        return true;
+    }
+  }
+}
@@ -0,0 +1,47 @@
+#include "transition.h"
+
+// Progress value representing a completed transition, in 16.16 fixed point
+#define TRANSITION_PROGRESS_MAX 0x10000UL
+
+uint32_t transitionEase(TransitionEasingEnum easing, uint32_t progress) {
+  uint64_t t = progress;
+  switch (easing) {
+    case TransitionEasingEnum::SmoothEasing:
+      // t^2 * (3 - 2t)
+      return (t * t * (3 * TRANSITION_PROGRESS_MAX - 2 * t)) >> 32;
+    case TransitionEasingEnum::EaseOutEasing: {
+      // 1 - (1 - t)^2
+      uint64_t remaining = TRANSITION_PROGRESS_MAX - t;
+      return TRANSITION_PROGRESS_MAX - ((remaining * remaining) >> 16);
+    }
+    case TransitionEasingEnum::LinearEasing:
+    default:
+      return progress;
+  }
+}
+
+void transitionStart(Transition &transition, const OutputFrame &displayed, uint32_t nowMillis) {
+  if (!transition.durationMs) return;
+
+  transition.from = displayed;
+  transition.startMillis = nowMillis;
+  transition.active = true;
+}
+
+void transitionApply(Transition &transition, const OutputFrame &target, uint32_t nowMillis, OutputFrame &out) {
+  uint32_t elapsed = nowMillis - transition.startMillis;
+  if (!transition.active || elapsed >= transition.durationMs) {
+    transition.active = false;
+    out = target;
+    return;
+  }
+
+  uint32_t progress = (uint64_t)elapsed * TRANSITION_PROGRESS_MAX / transition.durationMs;
+  int32_t eased = transitionEase(transition.easing, progress);
+
+  for (int i = 0; i < ChannelLast; i++) {
+    int32_t from = transition.from.levels[i];
+    int32_t delta = target.levels[i] - from;
+    out.levels[i] = from + (int32_t)(((int64_t)delta * eased) >> 16);
+  }
+}
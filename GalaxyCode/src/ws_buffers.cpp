@@ -0,0 +1,76 @@
+#include "ws_buffers.h"
+
+#include <atomic>
+
+WsBufferStats wsBufferStats = {0, 0, 0};
+
+struct PooledBuffer {
+  AsyncWebSocketMessageBuffer *buffer;
+  bool filling;                    // Taken by the broadcast being built; only touched by the state owner
+  std::atomic<uint16_t> messages;  // Messages referring to the buffer that have not been deleted yet
+};
+
+static PooledBuffer pool[WS_BROADCAST_BUFFERS] = {};
+
+/**
+ * Find the pool entry of a buffer.
+ */
+static PooledBuffer *findBuffer(AsyncWebSocketMessageBuffer *buffer) {
+  for (PooledBuffer &pooled : pool) {
+    if (pooled.buffer == buffer) return &pooled;
+  }
+  return nullptr;
+}
+
+void wsBuffersBegin() {
+  for (PooledBuffer &pooled : pool) {
+    if (pooled.buffer) continue;
+    pooled.buffer = new AsyncWebSocketMessageBuffer(WS_BROADCAST_BUFFER_SIZE);
+    wsBufferStats.allocations++;
+  }
+}
+
+AsyncWebSocketMessageBuffer *wsBufferAcquire(size_t length) {
+  // The message count is acquired, so the deleted messages are done with the data
+  PooledBuffer *free = nullptr;
+  for (PooledBuffer &pooled : pool) {
+    if (!pooled.buffer || pooled.filling || pooled.messages.load(std::memory_order_acquire)) continue;
+    if (pooled.buffer->length() == length) {
+      free = &pooled;
+      break;
+    }
+    if (!free) free = &pooled;
+  }
+
+  if (!free) {
+    wsBufferStats.exhausted++;
+    return nullptr;
+  }
+
+  if (free->buffer->length() != length) {
+    if (!free->buffer->reserve(length)) {
+      wsBufferStats.exhausted++;
+      return nullptr;
+    }
+    wsBufferStats.allocations++;
+  }
+
+  free->filling = true;
+  wsBufferStats.acquired++;
+  return free->buffer;
+}
+
+void wsBufferRelease(AsyncWebSocketMessageBuffer *buffer) {
+  PooledBuffer *pooled = findBuffer(buffer);
+  if (pooled) pooled->filling = false;
+}
+
+void wsBufferAddMessage(AsyncWebSocketMessageBuffer *buffer) {
+  PooledBuffer *pooled = findBuffer(buffer);
+  if (pooled) pooled->messages.fetch_add(1, std::memory_order_relaxed);
+}
+
+void wsBufferRemoveMessage(AsyncWebSocketMessageBuffer *buffer) {
+  PooledBuffer *pooled = findBuffer(buffer);
+  if (pooled) pooled->messages.fetch_sub(1, std::memory_order_release);
+}
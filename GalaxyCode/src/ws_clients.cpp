@@ -0,0 +1,198 @@
+#include "ws_clients.h"
+
+#include <atomic>
+
+#include "ws_buffers.h"
+#include "ws_protocol.h"
+
+struct WsClient {
+  uint32_t id;       // WebSocket client id, 0 for a free slot
+  uint32_t clientId; // The client's own id, 0 until it identifies itself
+  bool binary;
+  uint8_t fields;    // Subscribed fields
+  bool synced;       // Whether sent holds what the client was last sent
+  bool waiting;      // Whether a newer state is waiting for the state slot
+  DeviceState sent;
+  WsClientStats stats;
+};
+
+static WsClient clients[WS_MAX_CLIENTS] = {};
+
+// Guards the sessions between the network task and the state owner
+static portMUX_TYPE clientsLock = portMUX_INITIALIZER_UNLOCKED;
+
+// Task woken when a state slot frees up for a waiting state, and whether that has happened
+static TaskHandle_t ownerTask = nullptr;
+static std::atomic<bool> slotsReady(false);
+
+/**
+ * Find a client's session. The caller must hold clientsLock.
+ */
+static WsClient *findClient(uint32_t id) {
+  for (WsClient &client : clients) {
+    if (client.id == id) return &client;
+  }
+  return nullptr;
+}
+
+/**
+ * Count a message queued to a client.
+ */
+static void messageQueued(uint32_t id, bool state) {
+  portENTER_CRITICAL(&clientsLock);
+  WsClient *client = findClient(id);
+  if (client) {
+    WsClientStats &stats = client->stats;
+    stats.queued++;
+    if (++stats.depth > stats.maxDepth) stats.maxDepth = stats.depth;
+    if (state) stats.stateQueued = true;
+  }
+  portEXIT_CRITICAL(&clientsLock);
+}
+
+/**
+ * Count a message to a client that was sent or discarded, and free the state slot if it was
+ * a state message. Called by the web server from the network task, or from the state owner
+ * if the server refuses the message.
+ */
+static void messageDone(uint32_t id, bool state, bool sent) {
+  bool ready = false;
+
+  portENTER_CRITICAL(&clientsLock);
+  WsClient *client = findClient(id);
+  if (client) {
+    WsClientStats &stats = client->stats;
+    if (stats.depth) stats.depth--;
+    if (!sent) stats.dropped++;
+    if (state) {
+      stats.stateQueued = false;
+      // A lost delta leaves the client behind what the session recorded as sent
+      if (!sent) client->synced = false;
+      ready = client->waiting || !sent;
+      client->waiting = false;
+    }
+  }
+  portEXIT_CRITICAL(&clientsLock);
+
+  if (ready) {
+    slotsReady.store(true, std::memory_order_release);
+    if (ownerTask) xTaskNotifyGive(ownerTask);
+  }
+}
+
+WsStateMessage::WsStateMessage(uint32_t id, AsyncWebSocketMessageBuffer *buffer, bool binary)
+    : AsyncWebSocketMultiMessage(buffer, binary ? WS_BINARY : WS_TEXT), clientId(id), buffer(buffer) {
+  wsBufferAddMessage(buffer);
+  messageQueued(clientId, true);
+}
+
+WsStateMessage::~WsStateMessage() {
+  // The message has stopped sending, so the buffer can be reused
+  wsBufferRemoveMessage(buffer);
+  messageDone(clientId, true, _status == WS_MSG_SENT);
+}
+
+WsReplyMessage::WsReplyMessage(uint32_t id, const uint8_t *data, size_t length, bool binary)
+    : AsyncWebSocketBasicMessage((const char *)data, length, binary ? WS_BINARY : WS_TEXT), clientId(id) {
+  messageQueued(clientId, false);
+}
+
+WsReplyMessage::~WsReplyMessage() {
+  messageDone(clientId, false, _status == WS_MSG_SENT);
+}
+
+void wsClientsSetOwner(TaskHandle_t owner) {
+  ownerTask = owner;
+}
+
+bool wsClientsTakeReady() {
+  return slotsReady.exchange(false, std::memory_order_acquire);
+}
+
+bool wsClientAdd(uint32_t id, bool binary) {
+  portENTER_CRITICAL(&clientsLock);
+  WsClient *client = findClient(0);
+  if (client) {
+    client->id = id;
+    client->clientId = 0;
+    client->binary = binary;
+    client->fields = STATE_FIELDS_ALL;
+    client->synced = false;
+    client->waiting = false;
+    client->stats = {id, 0, 0, false, 0, 0, 0};
+  }
+  portEXIT_CRITICAL(&clientsLock);
+  return client != nullptr;
+}
+
+void wsClientRemove(uint32_t id) {
+  portENTER_CRITICAL(&clientsLock);
+  WsClient *client = findClient(id);
+  if (client) client->id = 0;
+  portEXIT_CRITICAL(&clientsLock);
+}
+
+void wsClientSubscribe(uint32_t id, uint8_t fields) {
+  portENTER_CRITICAL(&clientsLock);
+  WsClient *client = findClient(id);
+  if (client) {
+    client->fields = fields & STATE_FIELDS_ALL;
+    client->synced = false;
+  }
+  portEXIT_CRITICAL(&clientsLock);
+}
+
+void wsClientIdentify(uint32_t id, uint32_t clientId) {
+  portENTER_CRITICAL(&clientsLock);
+  WsClient *client = findClient(id);
+  if (client) client->clientId = clientId;
+  portEXIT_CRITICAL(&clientsLock);
+}
+
+uint32_t wsClientIdentity(uint32_t id) {
+  portENTER_CRITICAL(&clientsLock);
+  WsClient *client = findClient(id);
+  uint32_t clientId = client ? client->clientId : 0;
+  portEXIT_CRITICAL(&clientsLock);
+  return clientId;
+}
+
+void wsClientResync(uint32_t id) {
+  portENTER_CRITICAL(&clientsLock);
+  WsClient *client = findClient(id);
+  if (client) client->synced = false;
+  portEXIT_CRITICAL(&clientsLock);
+}
+
+bool wsClientTakeUpdate(int slot, const DeviceState &state, WsClientUpdate &update) {
+  portENTER_CRITICAL(&clientsLock);
+  WsClient &client = clients[slot];
+
+  uint8_t fields = 0;
+  if (client.id) {
+    fields = client.fields;
+    if (client.synced) fields &= wsStateFieldsChanged(client.sent, state);
+
+    if (fields && client.stats.stateQueued) {
+      // Latest value wins: this state waits for the slot, replacing any that already waited
+      if (client.waiting) client.stats.replaced++;
+      client.waiting = true;
+      fields = 0;
+    } else {
+      client.sent = state;
+      client.synced = true;
+    }
+  }
+  update = {client.id, client.binary, fields};
+
+  portEXIT_CRITICAL(&clientsLock);
+  return fields != 0;
+}
+
+bool wsClientStats(int slot, WsClientStats &stats) {
+  portENTER_CRITICAL(&clientsLock);
+  stats = clients[slot].stats;
+  bool occupied = clients[slot].id != 0;
+  portEXIT_CRITICAL(&clientsLock);
+  return occupied;
+}
@@ -0,0 +1,210 @@
+#include "ws_protocol.h"
+
+#include "brightness.h"
+
+// Encoded size of each field's value (bytes)
+static const uint8_t FIELD_SIZES[FieldLast] = {1, 1, 1, 1, 1, 2, 2};
+
+// Command behind a Set or Increment of each field, CommandLast if the operation is not allowed
+static const CommandTypeEnum SET_COMMANDS[FieldLast] = {
+  SetPowerCommand, SetBrightnessCommand, SetColourCommand, SetMotorCommand,
+  CommandLast, BrightnessLevelCommand, FadeCommand
+};
+static const CommandTypeEnum INCREMENT_COMMANDS[FieldLast] = {
+  PowerCommand, BrightnessCommand, ColourCommand, MotorCommand,
+  CommandLast, BrightnessRampCommand, CommandLast
+};
+
+// Largest value a Set of each field accepts
+static const uint16_t SET_MAXIMUMS[FieldLast] = {
+  PowerLast - 1, BrightnessLast - 1, LedLast - 1, MotorLast - 1,
+  0, BRIGHTNESS_LEVEL_MAX, UINT16_MAX
+};
+
+/**
+ * Read a field's value from a state.
+ */
+static uint16_t fieldValue(const DeviceState &state, int field) {
+  switch (field) {
+    case PowerField: return state.power;
+    case BrightnessField: return state.brightness;
+    case ColourField: return state.colour;
+    case MotorField: return state.motor;
+    case CustomBrightnessField: return state.customBrightness;
+    case BrightnessLevelField: return state.brightnessLevel;
+    case FadeField: return state.fadeMs;
+    default: return 0;
+  }
+}
+
+/**
+ * Decode a Set or Increment frame.
+ */
+static bool decodeCommand(const uint8_t *data, size_t length, BinaryRequest &request) {
+  if (length < 2) return false;
+
+  uint8_t operation = data[0] >> 4;
+  uint8_t field = data[0] & 0x0F;
+  if (field >= FieldLast || length != 1U + FIELD_SIZES[field]) return false;
+
+  if (operation == SetOperation) {
+    request.operation = SetOperation;
+    request.command = SET_COMMANDS[field];
+    request.value = FIELD_SIZES[field] == 1 ? data[1] : (uint32_t)(data[1] | (data[2] << 8));
+
+    // Refuse it here rather than have the state owner ignore it, so a sequenced Set is never
+    // acked as applied when it did nothing
+    if (request.value > SET_MAXIMUMS[field]) return false;
+  } else if (operation == IncrementOperation) {
+    // Increments are signed
+    request.operation = IncrementOperation;
+    request.command = INCREMENT_COMMANDS[field];
+    request.value = FIELD_SIZES[field] == 1 ? (int8_t)data[1] : (int16_t)(data[1] | (data[2] << 8));
+  } else {
+    return false;
+  }
+
+  return request.command != CommandLast;
+}
+
+bool wsBinaryDecodeRequest(const uint8_t *data, size_t length, BinaryRequest &request) {
+  request = {};
+  if (length < 2) return false;
+
+  switch (data[0]) {
+    case SubscribeOperation << 4:
+      if (length != 2) return false;
+      request.operation = SubscribeOperation;
+      request.value = data[1] & STATE_FIELDS_ALL;
+      return true;
+
+    case HelloOperation << 4:
+      if (length != 5) return false;
+      request.operation = HelloOperation;
+      request.value = data[1] | data[2] << 8 | data[3] << 16 | (uint32_t)data[4] << 24;
+      return request.value != 0;
+
+    case SequencedOperation << 4:
+      if (length < 3) return false;
+      request.sequenced = true;
+      request.sequence = data[1] | data[2] << 8;
+      return decodeCommand(data + 3, length - 3, request);
+
+    default:
+      return decodeCommand(data, length, request);
+  }
+}
+
+size_t wsBinaryEncodeAck(uint16_t sequence, AckStatusEnum status, uint32_t version, uint8_t *out) {
+  out[0] = AckOperation << 4;
+  out[1] = sequence;
+  out[2] = sequence >> 8;
+  out[3] = status;
+  out[4] = version;
+  out[5] = version >> 8;
+  out[6] = version >> 16;
+  out[7] = version >> 24;
+  return WS_BINARY_ACK_FRAME;
+}
+
+uint8_t wsStateFieldsChanged(const DeviceState &previous, const DeviceState &current) {
+  uint8_t changed = 0;
+  for (int field = 0; field < FieldLast; field++) {
+    if (fieldValue(previous, field) != fieldValue(current, field)) changed |= 1 << field;
+  }
+  return changed;
+}
+
+size_t wsBinaryEncodeState(const DeviceState &state, uint32_t version, uint8_t fields, uint8_t *out) {
+  size_t length = 0;
+  out[length++] = StateOperation << 4;
+  out[length++] = version;
+  out[length++] = version >> 8;
+  out[length++] = version >> 16;
+  out[length++] = version >> 24;
+  out[length++] = fields;
+
+  for (int field = 0; field < FieldLast; field++) {
+    if (!(fields & (1 << field))) continue;
+    uint16_t value = fieldValue(state, field);
+    out[length++] = value;
+    if (FIELD_SIZES[field] == 2) out[length++] = value >> 8;
+  }
+
+  return length;
+}
+
+// How a text command gets its value
+enum TextArgumentEnum {
+  StepArgument,        // No argument, one step forward
+  ClientArgument,      // No argument, the value is the client id
+  PercentArgument,     // Brightness level as a percentage
+  MillisecondsArgument // Duration in milliseconds, 0-65535
+};
+
+// X(name, argument, command)
+#define TEXT_COMMANDS(X) \
+  X("Power",      StepArgument,         PowerCommand) \
+  X("Brightness", StepArgument,         BrightnessCommand) \
+  X("Colour",     StepArgument,         ColourCommand) \
+  X("Motor",      StepArgument,         MotorCommand) \
+  X("getStates",  ClientArgument,       GetStatesCommand) \
+  X("Brightness", PercentArgument,      BrightnessLevelCommand) \
+  X("Fade",       MillisecondsArgument, FadeCommand)
+
+struct TextCommand {
+  const char *name;
+  uint8_t nameLength;
+  TextArgumentEnum argument;
+  CommandTypeEnum command;
+};
+
+// The name lengths are worked out at compile time, so most entries are ruled out by comparing
+// a single byte before any memcmp
+#define TEXT_COMMAND_ENTRY(name, argument, command) {name, sizeof(name) - 1, argument, command},
+static const TextCommand TEXT_COMMANDS_TABLE[] = {TEXT_COMMANDS(TEXT_COMMAND_ENTRY)};
+
+/**
+ * Parse an unsigned decimal argument, saturating at UINT32_MAX.
+ *
+ * @return Whether the argument is one or more digits and nothing else.
+ */
+static bool parseDecimal(const uint8_t *data, size_t length, uint32_t &value) {
+  if (!length) return false;
+
+  uint64_t result = 0;
+  for (size_t i = 0; i < length; i++) {
+    if (data[i] < '0' || data[i] > '9') return false;
+    if (result <= UINT32_MAX) result = result * 10 + (data[i] - '0');
+  }
+  value = result > UINT32_MAX ? UINT32_MAX : result;
+  return true;
+}
+
+bool wsTextDecodeRequest(const uint8_t *data, size_t length, CommandTypeEnum &command, uint32_t &value) {
+  // Split the name from the argument
+  const uint8_t *colon = (const uint8_t *)memchr(data, ':', length);
+  size_t nameLength = colon ? colon - data : length;
+  bool hasArgument = colon != nullptr;
+
+  for (const TextCommand &entry : TEXT_COMMANDS_TABLE) {
+    if (entry.nameLength != nameLength || memcmp(entry.name, data, nameLength) != 0) continue;
+
+    bool takesArgument = entry.argument == PercentArgument || entry.argument == MillisecondsArgument;
+    if (takesArgument != hasArgument) continue;
+
+    uint32_t argument = 0;
+    if (takesArgument && !parseDecimal(colon + 1, length - nameLength - 1, argument)) return false;
+
+    command = entry.command;
+    switch (entry.argument) {
+      case StepArgument: value = 1; break;
+      case ClientArgument: value = 0; break;
+      case PercentArgument: value = brightnessLevelFromPercent(argument); break;
+      case MillisecondsArgument: value = argument > UINT16_MAX ? UINT16_MAX : argument; break;
+    }
+    return true;
+  }
+
+  return false;
+}
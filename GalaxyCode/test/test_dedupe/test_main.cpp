@@ -0,0 +1,99 @@
+/*
+ * Host tests of the sequenced command duplicate detection (command_dedupe.h).
+ *
+ * Run with pio test -e native. The table is shared by the whole run, so each test uses its
+ * own client ids.
+ */
+#include <Arduino.h>
+#include <unity.h>
+
+#include "command_dedupe.h"
+
+void setUp() {}
+
+void tearDown() {}
+
+static void test_replay_is_duplicate() {
+  TEST_ASSERT_EQUAL_INT(DedupeNew, dedupeCheck(1, 100));
+  TEST_ASSERT_EQUAL_INT(DedupeDuplicate, dedupeCheck(1, 100));
+
+  TEST_ASSERT_EQUAL_INT(DedupeNew, dedupeCheck(1, 101));
+  TEST_ASSERT_EQUAL_INT(DedupeDuplicate, dedupeCheck(1, 100));
+  TEST_ASSERT_EQUAL_INT(DedupeDuplicate, dedupeCheck(1, 101));
+}
+
+static void test_reorder_inside_window() {
+  TEST_ASSERT_EQUAL_INT(DedupeNew, dedupeCheck(2, 5));
+  TEST_ASSERT_EQUAL_INT(DedupeNew, dedupeCheck(2, 7));
+  TEST_ASSERT_EQUAL_INT(DedupeNew, dedupeCheck(2, 6));
+  TEST_ASSERT_EQUAL_INT(DedupeDuplicate, dedupeCheck(2, 6));
+
+  // 4 was never seen, and is only behind
+  TEST_ASSERT_EQUAL_INT(DedupeNew, dedupeCheck(2, 4));
+
+  // The oldest number still tracked is DEDUPE_WINDOW - 1 behind the highest
+  TEST_ASSERT_EQUAL_INT(DedupeNew, dedupeCheck(2, 40));
+  TEST_ASSERT_EQUAL_INT(DedupeNew, dedupeCheck(2, 40 - (DEDUPE_WINDOW - 1)));
+  TEST_ASSERT_EQUAL_INT(DedupeDuplicate, dedupeCheck(2, 40 - (DEDUPE_WINDOW - 1)));
+  TEST_ASSERT_EQUAL_INT(DedupeStale, dedupeCheck(2, 40 - DEDUPE_WINDOW));
+}
+
+static void test_older_than_window_is_stale() {
+  TEST_ASSERT_EQUAL_INT(DedupeNew, dedupeCheck(3, 10));
+  TEST_ASSERT_EQUAL_INT(DedupeNew, dedupeCheck(3, 10 + DEDUPE_WINDOW));
+  TEST_ASSERT_EQUAL_INT(DedupeStale, dedupeCheck(3, 10));
+  TEST_ASSERT_EQUAL_INT(DedupeStale, dedupeCheck(3, 9));
+
+  // A jump of a whole window or more forgets everything below the new highest
+  TEST_ASSERT_EQUAL_INT(DedupeNew, dedupeCheck(3, 1000));
+  TEST_ASSERT_EQUAL_INT(DedupeStale, dedupeCheck(3, 10 + DEDUPE_WINDOW));
+  TEST_ASSERT_EQUAL_INT(DedupeDuplicate, dedupeCheck(3, 1000));
+}
+
+static void test_sequence_wraps() {
+  TEST_ASSERT_EQUAL_INT(DedupeNew, dedupeCheck(4, 65534));
+  TEST_ASSERT_EQUAL_INT(DedupeNew, dedupeCheck(4, 0));
+  TEST_ASSERT_EQUAL_INT(DedupeNew, dedupeCheck(4, 65535));
+  TEST_ASSERT_EQUAL_INT(DedupeDuplicate, dedupeCheck(4, 65534));
+  TEST_ASSERT_EQUAL_INT(DedupeDuplicate, dedupeCheck(4, 0));
+  TEST_ASSERT_EQUAL_INT(DedupeNew, dedupeCheck(4, 1));
+}
+
+static void test_forget_accepts_retry() {
+  TEST_ASSERT_EQUAL_INT(DedupeNew, dedupeCheck(5, 20));
+  TEST_ASSERT_EQUAL_INT(DedupeNew, dedupeCheck(5, 21));
+  dedupeForget(5, 20);
+  TEST_ASSERT_EQUAL_INT(DedupeNew, dedupeCheck(5, 20));
+  TEST_ASSERT_EQUAL_INT(DedupeDuplicate, dedupeCheck(5, 21));
+}
+
+static void test_least_recently_used_client_is_evicted() {
+  // Fill the table, evicting every client of the earlier tests
+  for (uint32_t id = 101; id < 101 + DEDUPE_CLIENTS; id++) {
+    TEST_ASSERT_EQUAL_INT(DedupeNew, dedupeCheck(id, 1));
+  }
+
+  // 101 is the oldest, but using it makes 102 the one to go
+  TEST_ASSERT_EQUAL_INT(DedupeDuplicate, dedupeCheck(101, 1));
+  TEST_ASSERT_EQUAL_INT(DedupeNew, dedupeCheck(200, 1));
+
+  TEST_ASSERT_EQUAL_INT(DedupeDuplicate, dedupeCheck(101, 1));
+  TEST_ASSERT_EQUAL_INT(DedupeDuplicate, dedupeCheck(200, 1));
+  for (uint32_t id = 103; id < 101 + DEDUPE_CLIENTS; id++) {
+    TEST_ASSERT_EQUAL_INT(DedupeDuplicate, dedupeCheck(id, 1));
+  }
+
+  // The evicted client starts over, so its replay is accepted again
+  TEST_ASSERT_EQUAL_INT(DedupeNew, dedupeCheck(102, 1));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_replay_is_duplicate);
+  RUN_TEST(test_reorder_inside_window);
+  RUN_TEST(test_older_than_window_is_stale);
+  RUN_TEST(test_sequence_wraps);
+  RUN_TEST(test_forget_accepts_retry);
+  RUN_TEST(test_least_recently_used_client_is_evicted);
+  return UNITY_END();
+}
@@ -0,0 +1,123 @@
+/*
+ * Host tests of the switch input and gesture timing (switch_input.h, gestures.h).
+ *
+ * Run with pio test -e native. The switches are driven through the NativeHal pin and
+ * virtual clock hooks, so the edges, debounce timers and gesture deadlines all run on the
+ * same simulated uptime.
+ */
+#include <Arduino.h>
+#include <NativeHal.h>
+#include <unity.h>
+
+#include <chrono>
+#include <thread>
+
+#include "gestures.h"
+#include "switch_input.h"
+
+// Any free GPIOs will do; only the colour switch is pressed
+static const uint8_t TEST_PINS[SwitchLast] = {26, 25, 33, 32};
+#define TEST_COLOUR_PIN 33
+
+#define MINUTES_US (60ULL * 1000 * 1000)
+
+static GestureRecogniser recogniser;
+static GestureEnum gestures[8];
+static int gestureCount;
+
+static void recordGesture(SwitchEnum button, GestureEnum gesture) {
+  if (button == ColourSwitch && gestureCount < 8) gestures[gestureCount++] = gesture;
+}
+
+// Step of the virtual clock, and the real time the debounce timer thread is given to notice
+// each step
+#define STEP_MS 2
+#define STEP_REAL_US 2500
+
+/**
+ * Advance the virtual clock in small steps, feeding switch transitions and timeouts to the
+ * recogniser the way the switch task does.
+ */
+static void run(uint32_t durationMs) {
+  for (uint32_t elapsed = 0; elapsed < durationMs; elapsed += STEP_MS) {
+    nativeAdvanceClock(STEP_MS * 1000);
+    std::this_thread::sleep_for(std::chrono::microseconds(STEP_REAL_US));
+
+    SwitchEvent event;
+    while (switchInputReceive(event, 0)) gestureSwitchEvent(recogniser, event);
+    gestureTick(recogniser, millis());
+  }
+}
+
+/**
+ * Tap the colour switch at a given uptime, recording the gestures it produces.
+ */
+static void tapAt(uint64_t uptimeMicros) {
+  nativeUseVirtualClock(uptimeMicros);
+  gestureBegin(recogniser, recordGesture);
+  gestureCount = 0;
+
+  nativeSetPinLevel(TEST_COLOUR_PIN, LOW);
+  run(80);
+  nativeSetPinLevel(TEST_COLOUR_PIN, HIGH);
+  // Past the debounce, the double press window and the long press time
+  run(SWITCH_DEBOUNCE_MS + GESTURE_DOUBLE_PRESS_MS + GESTURE_LONG_PRESS_MS);
+}
+
+static void assertSingleTap() {
+  TEST_ASSERT_EQUAL_INT(1, gestureCount);
+  TEST_ASSERT_EQUAL_INT(TapGesture, gestures[0]);
+}
+
+void setUp() {}
+void tearDown() {}
+
+void test_tap_after_10_minutes() {
+  tapAt(10 * MINUTES_US);
+  assertSingleTap();
+}
+
+// 2^32 us is about 71.6 minutes: edge times must not wrap apart from millis()
+void test_tap_after_80_minutes() {
+  tapAt(80 * MINUTES_US);
+  assertSingleTap();
+}
+
+void test_tap_after_200_minutes() {
+  tapAt(200 * MINUTES_US);
+  assertSingleTap();
+}
+
+// millis() itself wraps after about 49.7 days
+void test_tap_across_millis_wrap() {
+  tapAt((1ULL << 32) * 1000 - 40 * 1000);
+  assertSingleTap();
+}
+
+void test_long_press_after_80_minutes() {
+  nativeUseVirtualClock(80 * MINUTES_US);
+  gestureBegin(recogniser, recordGesture);
+  gestureCount = 0;
+
+  nativeSetPinLevel(TEST_COLOUR_PIN, LOW);
+  run(GESTURE_LONG_PRESS_MS + 10);
+  nativeSetPinLevel(TEST_COLOUR_PIN, HIGH);
+  run(SWITCH_DEBOUNCE_MS + 10);
+
+  TEST_ASSERT_GREATER_OR_EQUAL_INT(1, gestureCount);
+  TEST_ASSERT_EQUAL_INT(LongPressGesture, gestures[0]);
+}
+
+int main() {
+  nativeUseVirtualClock(0);
+  for (uint8_t pin : TEST_PINS) nativeSetPinLevel(pin, HIGH);
+  switchInputBegin(TEST_PINS);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_tap_after_10_minutes);
+  RUN_TEST(test_tap_after_80_minutes);
+  RUN_TEST(test_tap_after_200_minutes);
+  RUN_TEST(test_tap_across_millis_wrap);
+  RUN_TEST(test_long_press_after_80_minutes);
+  return UNITY_END();
+}
@@ -0,0 +1,71 @@
+/*
+ * Host tests of the binary WebSocket request decoding (ws_protocol.h).
+ *
+ * Run with pio test -e native.
+ */
+#include <Arduino.h>
+#include <unity.h>
+
+#include "ws_protocol.h"
+
+void setUp() {}
+
+void tearDown() {}
+
+static void test_set_in_range_decodes() {
+  uint8_t frame[] = {SetOperation << 4 | ColourField, LedLast - 1};
+  BinaryRequest request;
+  TEST_ASSERT_TRUE(wsBinaryDecodeRequest(frame, sizeof(frame), request));
+  TEST_ASSERT_EQUAL_INT(SetColourCommand, request.command);
+  TEST_ASSERT_EQUAL_UINT32(LedLast - 1, request.value);
+}
+
+static void test_set_out_of_range_is_invalid() {
+  uint8_t power[] = {SetOperation << 4 | PowerField, PowerLast};
+  uint8_t brightness[] = {SetOperation << 4 | BrightnessField, BrightnessLast};
+  uint8_t colour[] = {SetOperation << 4 | ColourField, 0xFF};
+  uint8_t motor[] = {SetOperation << 4 | MotorField, MotorLast};
+  BinaryRequest request;
+  TEST_ASSERT_FALSE(wsBinaryDecodeRequest(power, sizeof(power), request));
+  TEST_ASSERT_FALSE(wsBinaryDecodeRequest(brightness, sizeof(brightness), request));
+  TEST_ASSERT_FALSE(wsBinaryDecodeRequest(colour, sizeof(colour), request));
+  TEST_ASSERT_FALSE(wsBinaryDecodeRequest(motor, sizeof(motor), request));
+}
+
+static void test_sequenced_set_out_of_range_keeps_sequence() {
+  // Invalid, but the sequence number is decoded so the command can be acked as such
+  uint8_t frame[] = {SequencedOperation << 4, 0x34, 0x12, SetOperation << 4 | MotorField, MotorLast};
+  BinaryRequest request;
+  TEST_ASSERT_FALSE(wsBinaryDecodeRequest(frame, sizeof(frame), request));
+  TEST_ASSERT_TRUE(request.sequenced);
+  TEST_ASSERT_EQUAL_UINT16(0x1234, request.sequence);
+}
+
+static void test_increment_wraps_rather_than_range_checks() {
+  // Increments step and wrap, so any signed amount is valid
+  uint8_t frame[] = {SequencedOperation << 4, 1, 0, IncrementOperation << 4 | ColourField, 0xFF};
+  BinaryRequest request;
+  TEST_ASSERT_TRUE(wsBinaryDecodeRequest(frame, sizeof(frame), request));
+  TEST_ASSERT_EQUAL_INT(ColourCommand, request.command);
+  TEST_ASSERT_EQUAL_INT(-1, (int32_t)request.value);
+}
+
+static void test_sixteen_bit_sets_take_the_full_range() {
+  uint8_t level[] = {SetOperation << 4 | BrightnessLevelField, 0xFF, 0xFF};
+  uint8_t fade[] = {SetOperation << 4 | FadeField, 0xFF, 0xFF};
+  BinaryRequest request;
+  TEST_ASSERT_TRUE(wsBinaryDecodeRequest(level, sizeof(level), request));
+  TEST_ASSERT_EQUAL_UINT32(BRIGHTNESS_LEVEL_MAX, request.value);
+  TEST_ASSERT_TRUE(wsBinaryDecodeRequest(fade, sizeof(fade), request));
+  TEST_ASSERT_EQUAL_UINT32(UINT16_MAX, request.value);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_set_in_range_decodes);
+  RUN_TEST(test_set_out_of_range_is_invalid);
+  RUN_TEST(test_sequenced_set_out_of_range_keeps_sequence);
+  RUN_TEST(test_increment_wraps_rather_than_range_checks);
+  RUN_TEST(test_sixteen_bit_sets_take_the_full_range);
+  return UNITY_END();
+}